@@ -0,0 +1,218 @@
+/* per-wakeup cost of the sender's two-action loop (fill the window when
+   it's open, read acks when they arrive) under Poller's poll and epoll
+   backends and under EdgePoller, on a UDP socket talking to itself */
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "socket.hh"
+#include "poller.hh"
+#include "edge_poller.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* datagrams in flight at once, and how many each run sends */
+static const unsigned int WINDOW = 16;
+static const uint64_t DATAGRAMS = 2000000;
+
+/* what each loop does on a wakeup (shared so only the dispatch differs) */
+class Flow
+{
+private:
+  UDPSocket socket_;
+  UDPSocket::ReceiveBuffer acks_;
+  vector<string> packets_;
+  unsigned int in_flight_;
+  uint64_t datagrams_;
+
+public:
+  Flow()
+    : socket_(), acks_( WINDOW ), packets_( WINDOW, string( 64, 'x' ) ),
+      in_flight_( 0 ), datagrams_( 0 )
+  {
+    /* every datagram comes straight back as its own "ack" */
+    socket_.bind( Address( "::1", "0" ) );
+    socket_.connect( socket_.local_address() );
+  }
+
+  UDPSocket & socket() { return socket_; }
+  bool window_is_open() const { return in_flight_ < WINDOW; }
+  uint64_t datagrams() const { return datagrams_; }
+
+  void fill_window()
+  {
+    const size_t count = WINDOW - in_flight_;
+    socket_.send_batch( packets_.data(), count );
+    in_flight_ += count;
+    datagrams_ += count;
+  }
+
+  void got_acks( const size_t count ) { in_flight_ -= count; }
+
+  UDPSocket::ReceiveBuffer & acks() { return acks_; }
+};
+
+/* the loops do the same syscalls per datagram, except for what the
+   dispatch adds (e.g. epoll_ctl() as Out interest comes and goes), so
+   compare time per datagram and how many wakeups it took */
+static void report( const string & name, const uint64_t elapsed_ns,
+		    const uint64_t wakeups, const Flow & flow )
+{
+  cout << name << ": " << double( elapsed_ns ) / flow.datagrams() << " ns/datagram, "
+       << double( elapsed_ns ) / wakeups << " ns/wakeup, "
+       << double( flow.datagrams() ) / wakeups << " datagrams/wakeup" << endl;
+}
+
+static void benchmark_poller( const string & name, const Poller::Backend backend )
+{
+  Flow flow;
+  Poller poller( backend );
+
+  poller.add_action( Action( flow.socket(), Direction::Out, [&] () {
+	flow.fill_window();
+	return ResultType::Continue;
+      },
+      [&] () { return flow.window_is_open(); } ) );
+
+  /* (refill the window as soon as the acks are read, as EdgePoller's
+     handler does, so both loops move the same batch per wakeup; the Out
+     action only has to start things off) */
+  poller.add_action( Action( flow.socket(), Direction::In, [&] () {
+	flow.got_acks( flow.socket().recv_batch( flow.acks() ) );
+	if ( flow.window_is_open() ) {
+	  flow.fill_window();
+	}
+	return ResultType::Continue;
+      } ) );
+
+  uint64_t wakeups = 0;
+  const uint64_t start = timestamp_ns();
+  while ( flow.datagrams() < DATAGRAMS ) {
+    poller.poll( -1 );
+    wakeups++;
+  }
+  report( name, timestamp_ns() - start, wakeups, flow );
+}
+
+static void benchmark_edge_poller()
+{
+  Flow flow;
+  EdgePoller poller;
+  poller.add( flow.socket(), EPOLLIN | EPOLLOUT, 0 );
+
+  const auto handler = [&] ( const uint32_t, const uint32_t events ) -> Result {
+    if ( events & EPOLLIN ) {
+      while ( const size_t count = flow.socket().try_recv_batch( flow.acks() ) ) {
+	flow.got_acks( count );
+      }
+    }
+
+    if ( flow.window_is_open() ) {
+      flow.fill_window();
+    }
+
+    return ResultType::Continue;
+  };
+
+  uint64_t wakeups = 0;
+  const uint64_t start = timestamp_ns();
+  while ( flow.datagrams() < DATAGRAMS ) {
+    poller.poll( -1, handler );
+    wakeups++;
+  }
+  report( "EdgePoller", timestamp_ns() - start, wakeups, flow );
+}
+
+/* per-wakeup cost of Poller as idle flows (a socket with nothing to
+   read and a closed window) pile up next to the busy one: poll() looks
+   at every fd on every iteration while epoll doesn't, and an Out action
+   with a when_interested() is asked on every iteration, while one
+   driven by set_interest() costs nothing until its interest changes */
+static void benchmark_idle_flows( const size_t idle, const Poller::Backend backend,
+				  const bool explicit_interest )
+{
+  Flow flow;
+  Poller poller( backend );
+
+  size_t send_action = 0;
+  const auto update_send_interest = [&] () {
+    if ( explicit_interest ) {
+      poller.set_interest( send_action, flow.window_is_open() );
+    }
+  };
+
+  send_action = poller.add_action( Action( flow.socket(), Direction::Out, [&] () {
+	flow.fill_window();
+	update_send_interest();
+	return ResultType::Continue;
+      },
+      explicit_interest ? function<bool(void)>() : [&] () { return flow.window_is_open(); } ) );
+
+  poller.add_action( Action( flow.socket(), Direction::In, [&] () {
+	flow.got_acks( flow.socket().recv_batch( flow.acks() ) );
+	update_send_interest();
+	return ResultType::Continue;
+      } ) );
+
+  vector<unique_ptr<UDPSocket>> idle_sockets;
+  for ( size_t i = 0; i < idle; i++ ) {
+    idle_sockets.emplace_back( new UDPSocket );
+    UDPSocket & socket = *idle_sockets.back();
+    socket.bind( Address( "::1", "0" ) );
+
+    poller.add_action( Action( socket, Direction::In, [&socket] () {
+	  socket.recv();
+	  return ResultType::Continue;
+	} ) );
+
+    const size_t closed_window = poller.add_action( Action( socket, Direction::Out, [&socket] () {
+	  socket.send( "" );
+	  return ResultType::Continue;
+	},
+	explicit_interest ? function<bool(void)>() : [] () { return false; } ) );
+    poller.set_interest( closed_window, false );
+  }
+
+  uint64_t wakeups = 0;
+  const uint64_t start = timestamp_ns();
+  while ( flow.datagrams() < DATAGRAMS / 10 ) {
+    poller.poll( -1 );
+    wakeups++;
+  }
+  report( string( backend == Poller::Backend::Epoll ? "Poller (epoll), " : "Poller (poll), " )
+	  + to_string( idle ) + " idle flows, "
+	  + (explicit_interest ? "set_interest()" : "when_interested()"),
+	  timestamp_ns() - start, wakeups, flow );
+}
+
+int main()
+{
+  try {
+    benchmark_poller( "Poller (poll)", Poller::Backend::Poll );
+    benchmark_poller( "Poller (epoll)", Poller::Backend::Epoll );
+    benchmark_edge_poller();
+
+    for ( const size_t idle : { 0, 100, 400 } ) {
+      benchmark_idle_flows( idle, Poller::Backend::Epoll, false );
+      benchmark_idle_flows( idle, Poller::Backend::Epoll, true );
+    }
+
+    /* where epoll starts to pay for itself (see the sender's choice of backend) */
+    for ( const size_t idle : { 0, 7, 31, 127, 255 } ) {
+      benchmark_idle_flows( idle, Poller::Backend::Poll, true );
+      benchmark_idle_flows( idle, Poller::Backend::Epoll, true );
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
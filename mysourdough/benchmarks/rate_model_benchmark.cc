@@ -0,0 +1,204 @@
+/* per-tick cost of the controller's rate-model steps, and how far apart
+   the answers are: the original dense evolution loop (two erfc() calls
+   per pair of buckets) against the precomputed, banded TransitionKernel,
+   the original linear-space Poisson update against the log-space
+   PoissonLikelihood, over a range of acks per tick, and the banded
+   against the FFT convolution as the grid grows */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "transition_kernel.hh"
+#include "poisson_likelihood.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* the controller's parameters */
+static const int BUCKETS = 200;
+static const double WIDTH = 1.0 / 20.0;
+static const double BROWNIAN_MOTION = 200.0;
+static const double TICK_SECONDS = 0.020;
+
+static const double ACKS_PER_BUCKET = WIDTH * TICK_SECONDS; /* expected per tick */
+
+/* ticks per run (the stddev grows every tick, as in the controller) */
+static const int TICKS = 2000;
+
+/* the evolution step as Controller::ack_received used to compute it */
+static void dense_step( const double stddev, const vector<double> & in, vector<double> & out )
+{
+  const auto cdf = [stddev] ( const double x ) { return 0.5 * erfc( -1 * x / stddev ); };
+
+  for ( int new_rate = 1; new_rate < BUCKETS; new_rate++ ) {
+    out[ new_rate ] = 0.0;
+    for ( int old_rate = 1; old_rate < BUCKETS; old_rate++ ) {
+      out[ new_rate ] += in[ old_rate ]
+	* (cdf( new_rate + WIDTH - old_rate ) - cdf( new_rate - old_rate ));
+    }
+  }
+}
+
+/* the likelihood update as Controller::ack_received used to compute it */
+static uint64_t factorial( const uint64_t n ) { return n == 0 ? 1 : n * factorial( n - 1 ); }
+
+static void linear_update( vector<double> & probability, const uint64_t count )
+{
+  double sum = 0;
+  for ( int i = 0; i < BUCKETS; i++ ) {
+    double p = pow( i * ACKS_PER_BUCKET, count );
+    p /= double( factorial( count ) );
+    p *= exp( -1 * i * ACKS_PER_BUCKET );
+    probability[ i ] *= p;
+    sum += probability[ i ];
+  }
+
+  for ( auto & x : probability ) {
+    x /= sum;
+  }
+}
+
+/* a lumpy distribution to evolve */
+static vector<double> starting_distribution( const int buckets = BUCKETS )
+{
+  vector<double> probability( buckets );
+  double sum = 0;
+  for ( int i = 0; i < buckets; i++ ) {
+    probability[ i ] = 1.0 + sin( i / 7.0 ) + (i % 13 == 0 ? 5.0 : 0.0);
+    sum += probability[ i ];
+  }
+
+  for ( auto & x : probability ) {
+    x /= sum;
+  }
+
+  return probability;
+}
+
+/* per-tick cost of one way of evolving a grid (recomputing the weights
+   every tick, since the controller's stddev grows every tick) */
+static uint64_t evolve_ns( const int buckets, const double stddev, const TransitionKernel::Method method,
+			   const vector<double> & in, vector<double> & out )
+{
+  const int ticks = 10;
+  TransitionKernel kernel( buckets, WIDTH, method );
+
+  const uint64_t start = timestamp_ns();
+  for ( int tick = 0; tick < ticks; tick++ ) {
+    kernel.set_stddev( stddev * (1 + tick * 1e-9) );
+    kernel.apply( in.data(), out.data() );
+  }
+  return (timestamp_ns() - start) / ticks;
+}
+
+/* banded against FFT convolution as the grid grows, at the controller's
+   stddev after one second and after a minute */
+static void grid_sweep()
+{
+  for ( const int buckets : { 200, 1024, 4096, 8192, 16384 } ) {
+    const vector<double> in = starting_distribution( buckets );
+    vector<double> banded_out( buckets ), fourier_out( buckets );
+
+    for ( const double seconds : { 1, 60 } ) {
+      const double stddev = BROWNIAN_MOTION * sqrt( seconds );
+      const uint64_t banded = evolve_ns( buckets, stddev, TransitionKernel::Method::Banded, in, banded_out );
+      const uint64_t fourier = evolve_ns( buckets, stddev, TransitionKernel::Method::Fourier, in, fourier_out );
+
+      TransitionKernel automatic( buckets, WIDTH );
+      automatic.set_stddev( stddev );
+
+      double l1 = 0;
+      for ( int i = 1; i < buckets; i++ ) {
+	l1 += fabs( banded_out[ i ] - fourier_out[ i ] );
+      }
+
+      cout << buckets << " buckets, band " << automatic.band() << ": banded " << banded / 1000.0
+	   << " us/tick, FFT " << fourier / 1000.0 << " us/tick, automatic picks "
+	   << (automatic.method() == TransitionKernel::Method::Fourier ? "FFT" : "banded")
+	   << ", difference " << l1 << " (L1)" << endl;
+    }
+  }
+}
+
+int main()
+{
+  try {
+    const vector<double> in = starting_distribution();
+    vector<double> dense_out( BUCKETS ), kernel_out( BUCKETS );
+    TransitionKernel kernel( BUCKETS, WIDTH );
+
+    uint64_t dense_ns = 0, kernel_ns = 0;
+    double worst_l1 = 0, worst_element = 0;
+
+    for ( int tick = 1; tick <= TICKS; tick++ ) {
+      const double stddev = BROWNIAN_MOTION * sqrt( tick * TICK_SECONDS );
+
+      uint64_t start = timestamp_ns();
+      dense_step( stddev, in, dense_out );
+      dense_ns += timestamp_ns() - start;
+
+      start = timestamp_ns();
+      kernel.set_stddev( stddev );
+      kernel.apply( in.data(), kernel_out.data() );
+      kernel_ns += timestamp_ns() - start;
+
+      double l1 = 0;
+      for ( int i = 1; i < BUCKETS; i++ ) {
+	const double difference = fabs( dense_out[ i ] - kernel_out[ i ] );
+	l1 += difference;
+	worst_element = max( worst_element, difference );
+      }
+      worst_l1 = max( worst_l1, l1 );
+    }
+
+    cout << "dense loop: " << double( dense_ns ) / TICKS << " ns/tick" << endl;
+    cout << "TransitionKernel: " << double( kernel_ns ) / TICKS << " ns/tick ("
+	 << double( dense_ns ) / kernel_ns << "x faster)" << endl;
+    cout << "largest difference: " << worst_l1 << " (L1), "
+	 << worst_element << " (one bucket)" << endl;
+
+    /* the likelihood step, at a range of ack counts (the distribution
+       is a fresh copy every tick, so only the cost is repeated) */
+    PoissonLikelihood likelihood( BUCKETS, ACKS_PER_BUCKET );
+    for ( const uint64_t count : { 0, 5, 20, 21, 50, 200, 1000 } ) {
+      vector<double> linear_out, log_out;
+      uint64_t linear_ns = 0, log_ns = 0;
+
+      for ( int tick = 0; tick < TICKS; tick++ ) {
+	linear_out = in;
+	uint64_t start = timestamp_ns();
+	linear_update( linear_out, count );
+	linear_ns += timestamp_ns() - start;
+
+	log_out = in;
+	start = timestamp_ns();
+	likelihood.update( log_out.data(), count );
+	log_ns += timestamp_ns() - start;
+      }
+
+      double l1 = 0, log_sum = 0;
+      for ( int i = 0; i < BUCKETS; i++ ) {
+	l1 += fabs( linear_out[ i ] - log_out[ i ] );
+	log_sum += log_out[ i ];
+      }
+
+      cout << count << " acks/tick: linear " << double( linear_ns ) / TICKS << " ns/tick, "
+	   << "log space " << double( log_ns ) / TICKS << " ns/tick (sums to " << log_sum << "), ";
+      if ( isfinite( l1 ) ) {
+	cout << "difference " << l1 << " (L1)" << endl;
+      } else {
+	cout << "linear result is not a distribution" << endl;
+      }
+    }
+
+    grid_sweep();
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
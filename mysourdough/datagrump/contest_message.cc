@@ -1,3 +1,4 @@
+#include <cstring>
 #include <stdexcept>
 
 #include "contest_message.hh"
@@ -6,82 +7,191 @@
 using namespace std;
 
 /* helper to get the nth uint64_t field (in network byte order) */
-uint64_t get_header_field( const size_t n, const string & str )
+uint64_t get_header_field( const size_t n, const char * data, const size_t length )
 {
-  if ( str.size() < (n + 1) * sizeof( uint64_t ) ) {
+  if ( length < (n + 1) * sizeof( uint64_t ) ) {
     throw runtime_error( "contest message too small to contain header" );
   }
 
-  const uint64_t * const data_ptr
-    = reinterpret_cast<const uint64_t *>( str.data() ) + n;
+  /* (views can point anywhere in a receive buffer, so don't assume alignment) */
+  uint64_t network_order;
+  memcpy( &network_order, data + n * sizeof( uint64_t ), sizeof( network_order ) );
 
-  return be64toh( *data_ptr );
+  return be64toh( network_order );
+}
+
+/* helpers to get and put a field of a compact header (in network byte order) */
+static uint32_t get_compact_field( const char * data )
+{
+  uint32_t network_order;
+  memcpy( &network_order, data, sizeof( network_order ) );
+  return be32toh( network_order );
+}
+
+static uint16_t get_compact_length( const char * data )
+{
+  uint16_t network_order;
+  memcpy( &network_order, data, sizeof( network_order ) );
+  return be16toh( network_order );
+}
+
+static void put_compact_field( const uint32_t value, char * dest )
+{
+  const uint32_t network_order = htobe32( value );
+  memcpy( dest, &network_order, sizeof( network_order ) );
+}
+
+static void put_compact_length( const uint16_t value, char * dest )
+{
+  const uint16_t network_order = htobe16( value );
+  memcpy( dest, &network_order, sizeof( network_order ) );
+}
+
+/* helper to turn a timestamp field from the wire into microseconds */
+static uint64_t decode_timestamp( const uint64_t field )
+{
+  if ( field == uint64_t( -1 ) ) {
+    return field; /* not set */
+  }
+
+  return (field & ContestMessage::FINE_TIMESTAMP)
+    ? field & ~ContestMessage::FINE_TIMESTAMP
+    : field * 1000;
+}
+
+/* helper to turn a timestamp in microseconds into a wire field */
+static uint64_t encode_timestamp( const uint64_t timestamp, const bool fine )
+{
+  if ( timestamp == uint64_t( -1 ) ) {
+    return timestamp; /* not set */
+  }
+
+  return fine ? timestamp | ContestMessage::FINE_TIMESTAMP : timestamp / 1000;
 }
 
 /* Parse header from wire */
 ContestMessage::Header::Header( const string & str )
-  : sequence_number( get_header_field( 0, str ) ),
-    send_timestamp( get_header_field( 1, str ) ),
-    ack_sequence_number( get_header_field( 2, str ) ),
-    ack_send_timestamp( get_header_field( 3, str ) ),
-    ack_recv_timestamp( get_header_field( 4, str ) ),
-    ack_payload_length( get_header_field( 5, str ) )
+  : Header( str.data(), str.size() )
+{}
+
+ContestMessage::Header::Header( const char * data, const size_t length )
+  : Header( View( data, length ) )
+{}
+
+ContestMessage::Header::Header( const View & view )
+  : sequence_number( view.sequence_number() ),
+    send_timestamp( view.send_timestamp() ),
+    ack_sequence_number( view.ack_sequence_number() ),
+    ack_send_timestamp( view.ack_send_timestamp() ),
+    ack_recv_timestamp( view.ack_recv_timestamp() ),
+    ack_payload_length( view.ack_payload_length() ),
+    /* answer in whichever unit and encoding the sender used */
+    fine_timestamps( view.fine_timestamps() ),
+    compact( view.compact() )
 {}
 
 /* Parse incoming message from wire */
 ContestMessage::ContestMessage( const string & str )
-  : header( str ),
-    payload( str.begin() + sizeof( header ), str.end() )
+  : ContestMessage( str.data(), str.size() )
+{}
+
+ContestMessage::ContestMessage( const char * data, const size_t length )
+  : header( data, length ),
+    payload( data + header.wire_size(), data + length )
 {}
 
 /* Fill in the send_timestamp for an outgoing message */
 void ContestMessage::set_send_timestamp()
 {
-  header.send_timestamp = timestamp_ms();
+  header.send_timestamp = timestamp_us();
+}
+
+/* helper to put the nth uint64_t field (in network byte order) */
+static void put_header_field( const size_t n, const uint64_t value, char * dest )
+{
+  const uint64_t network_order = htobe64( value );
+  memcpy( dest + n * sizeof( uint64_t ), &network_order, sizeof( network_order ) );
 }
 
-/* helper to put a uint64_t field (in network byte order) */
-string put_header_field( const uint64_t n )
+/* Size of the wire representation */
+size_t ContestMessage::Header::wire_size() const
 {
-  const uint64_t network_order = htobe64( n );
-  return string( reinterpret_cast<const char *>( &network_order ),
-		 sizeof( network_order ) );
+  if ( not compact ) {
+    return WIRE_SIZE;
+  }
+
+  return is_ack() ? COMPACT_ACK_SIZE : COMPACT_DATA_SIZE;
+}
+
+/* Write the wire representation into wire_size() bytes at dest */
+void ContestMessage::Header::write( char * dest ) const
+{
+  if ( compact ) {
+    dest[ 0 ] = COMPACT | COMPACT_VERSION | (is_ack() ? COMPACT_ACK : 0);
+    put_compact_field( sequence_number, dest + 1 );
+    put_compact_field( send_timestamp, dest + 5 );
+
+    if ( is_ack() ) {
+      put_compact_field( ack_sequence_number, dest + 9 );
+      put_compact_field( ack_send_timestamp, dest + 13 );
+      put_compact_field( ack_recv_timestamp, dest + 17 );
+      put_compact_length( ack_payload_length, dest + 21 );
+    }
+
+    return;
+  }
+
+  put_header_field( 0, sequence_number, dest );
+  put_header_field( 1, encode_timestamp( send_timestamp, fine_timestamps ), dest );
+  put_header_field( 2, ack_sequence_number, dest );
+  put_header_field( 3, encode_timestamp( ack_send_timestamp, fine_timestamps ), dest );
+  put_header_field( 4, encode_timestamp( ack_recv_timestamp, fine_timestamps ), dest );
+  put_header_field( 5, ack_payload_length, dest );
 }
 
 /* Make wire representation of header */
 string ContestMessage::Header::to_string() const
 {
-  return put_header_field( sequence_number )
-    + put_header_field( send_timestamp )
-    + put_header_field( ack_sequence_number )
-    + put_header_field( ack_send_timestamp )
-    + put_header_field( ack_recv_timestamp )
-    + put_header_field( ack_payload_length );
+  string ret( wire_size(), 0 );
+  write( &ret[ 0 ] );
+  return ret;
 }
 
 /* Make wire representation of message */
 string ContestMessage::to_string() const
 {
-  return header.to_string() + payload;
+  const size_t header_size = header.wire_size();
+  string ret( header_size + payload.size(), 0 );
+  header.write( &ret[ 0 ] );
+  payload.copy( &ret[ header_size ], payload.size() );
+  return ret;
 }
 
 /* Transform into an ack of the ContestMessage */
 void ContestMessage::transform_into_ack( const uint64_t sequence_number,
 					 const uint64_t recv_timestamp )
+{
+  header.transform_into_ack( sequence_number, recv_timestamp, payload.length() );
+
+  /* delete the payload */
+  payload.clear();
+}
+
+/* Transform into the header of an ack */
+void ContestMessage::Header::transform_into_ack( const uint64_t s_sequence_number,
+						 const uint64_t recv_timestamp,
+						 const uint64_t payload_length )
 {
   /* ack the old sequence number */
-  header.ack_sequence_number = header.sequence_number;
+  ack_sequence_number = sequence_number;
 
   /* now assign a new sequence number for the outgoing ack */
-  header.sequence_number = sequence_number;
+  sequence_number = s_sequence_number;
 
   /* ack the other fields */
-  header.ack_send_timestamp = header.send_timestamp;
-  header.ack_recv_timestamp = recv_timestamp;
-  header.ack_payload_length = payload.length();
-
-  /* delete the payload */
-  payload.clear();
+  ack_send_timestamp = send_timestamp;
+  ack_recv_timestamp = recv_timestamp;
+  ack_payload_length = payload_length;
 }
 
 /* New message */
@@ -98,11 +208,80 @@ ContestMessage::Header::Header( const uint64_t s_sequence_number )
     ack_sequence_number( -1 ),
     ack_send_timestamp( -1 ),
     ack_recv_timestamp( -1 ),
-    ack_payload_length( -1 )
+    ack_payload_length( -1 ),
+    fine_timestamps( true ),
+    compact( false )
 {}
 
 /* Is this message an ack? */
 bool ContestMessage::is_ack() const
 {
-  return header.ack_sequence_number != uint64_t( -1 );
+  return header.is_ack();
+}
+
+/* Check that the datagram holds a whole header */
+ContestMessage::View::View( const char * data, const size_t length )
+  : data_( data ),
+    length_( length ),
+    compact_( length and (data[ 0 ] & COMPACT) ),
+    header_size_( Header::WIRE_SIZE )
+{
+  if ( compact_ ) {
+    if ( (data[ 0 ] & COMPACT_VERSION_MASK) != COMPACT_VERSION ) {
+      throw runtime_error( "contest message has unknown header version" );
+    }
+
+    header_size_ = (data[ 0 ] & COMPACT_ACK) ? Header::COMPACT_ACK_SIZE : Header::COMPACT_DATA_SIZE;
+  }
+
+  if ( length_ < header_size_ ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+}
+
+/* the nth field, in the order of Header's (-1 if a compact datagram lacks it) */
+uint64_t ContestMessage::View::field( const size_t n ) const
+{
+  if ( not compact_ ) {
+    return get_header_field( n, data_, length_ );
+  }
+
+  if ( n >= 2 and header_size_ != Header::COMPACT_ACK_SIZE ) {
+    return -1;
+  }
+
+  if ( n == 5 ) {
+    return get_compact_length( data_ + 21 );
+  }
+
+  return get_compact_field( data_ + 1 + n * sizeof( uint32_t ) );
+}
+
+uint64_t ContestMessage::View::timestamp_field( const size_t n ) const
+{
+  /* compact timestamps are always in microseconds */
+  return compact_ ? field( n ) : decode_timestamp( field( n ) );
+}
+
+bool ContestMessage::View::fine_timestamps() const
+{
+  return compact_ or (field( 1 ) & FINE_TIMESTAMP);
+}
+
+/* Is this message an ack? */
+bool ContestMessage::View::is_ack() const
+{
+  return compact_ ? header_size_ == Header::COMPACT_ACK_SIZE
+    : ack_sequence_number() != uint64_t( -1 );
+}
+
+/* the full value, closest to reference, whose low 32 bits are value's */
+uint64_t ContestMessage::View::expand( const uint64_t value, const uint64_t reference ) const
+{
+  if ( not compact_ or value == uint64_t( -1 ) ) {
+    return value;
+  }
+
+  const int32_t offset = uint32_t( value ) - uint32_t( reference );
+  return reference + offset;
 }
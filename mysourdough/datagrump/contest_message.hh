@@ -6,6 +6,25 @@
 
 struct ContestMessage
 {
+  /* timestamps are in microseconds; on the wire, each one either has
+     FINE_TIMESTAMP set (microseconds) or not (the original milliseconds),
+     so peers that only speak milliseconds still interoperate */
+  static const uint64_t FINE_TIMESTAMP = uint64_t( 1 ) << 63;
+
+  /* A compact header (version 1) starts with a flags byte with COMPACT
+     set (the original header starts with the top byte of a sequence
+     number, so never does). Sequence numbers and timestamps (microseconds
+     since each host's program started) are cut to 32 bits, and unwrapped
+     by the other end against the last value it saw (see expand()); a data
+     datagram carries only those two, and an ack carries the ack fields
+     as well. */
+  static const uint8_t COMPACT = 0x80;
+  static const uint8_t COMPACT_VERSION = 0x10;
+  static const uint8_t COMPACT_VERSION_MASK = 0x70;
+  static const uint8_t COMPACT_ACK = 0x01;
+
+  class View;
+
   struct Header {
     uint64_t sequence_number;
     uint64_t send_timestamp;
@@ -15,16 +34,90 @@ struct ContestMessage
     uint64_t ack_recv_timestamp;
     uint64_t ack_payload_length;
 
+    /* write timestamps in microseconds (else milliseconds, as the
+       sender of a parsed message did) */
+    bool fine_timestamps;
+
+    /* write the compact encoding (else the original one, as the
+       sender of a parsed message did) */
+    bool compact;
+
+    /* sizes of the wire representations */
+    static const size_t WIRE_SIZE = 6 * sizeof( uint64_t );
+    static const size_t COMPACT_DATA_SIZE = 1 + 2 * sizeof( uint32_t );
+    static const size_t COMPACT_ACK_SIZE = COMPACT_DATA_SIZE + 3 * sizeof( uint32_t )
+      + sizeof( uint16_t );
+
     /* Header for new message */
     Header( const uint64_t s_sequence_number );
 
     /* Parse header from wire */
     Header( const std::string & str );
+    Header( const char * data, const size_t length );
+    Header( const View & view );
+
+    /* Size of the wire representation */
+    size_t wire_size() const;
 
     /* Make wire representation of header */
     std::string to_string() const;
+
+    /* Write the wire representation into wire_size() bytes at dest
+       (e.g. the front of a reused packet buffer) */
+    void write( char * dest ) const;
+
+    /* Is this the header of an ack? */
+    bool is_ack() const { return ack_sequence_number != uint64_t( -1 ); }
+
+    /* Transform into the header of an ack of a message
+       with payload_length bytes of payload */
+    void transform_into_ack( const uint64_t sequence_number,
+			     const uint64_t recv_timestamp,
+			     const uint64_t payload_length );
   } header;
 
+  /* A received datagram, read in place (the bytes must outlive the view) */
+  class View {
+  private:
+    const char * data_;
+    size_t length_;
+    bool compact_;
+    size_t header_size_;
+
+    /* the nth field, in the order of Header's (-1 if a compact datagram lacks it) */
+    uint64_t field( const size_t n ) const;
+    uint64_t timestamp_field( const size_t n ) const;
+
+  public:
+    /* Check that the datagram holds a whole header */
+    View( const char * data, const size_t length );
+
+    uint64_t sequence_number() const { return field( 0 ); }
+    uint64_t send_timestamp() const { return timestamp_field( 1 ); }
+
+    uint64_t ack_sequence_number() const { return field( 2 ); }
+    uint64_t ack_send_timestamp() const { return timestamp_field( 3 ); }
+    uint64_t ack_recv_timestamp() const { return timestamp_field( 4 ); }
+    uint64_t ack_payload_length() const { return field( 5 ); }
+
+    bool fine_timestamps() const;
+    bool compact() const { return compact_; }
+
+    /* Is this message an ack? */
+    bool is_ack() const;
+
+    /* A field of a compact header only holds the low 32 bits; this gives
+       the full value closest to reference (e.g. the receiver's current
+       sequence number or time). Fields of the original header pass through. */
+    uint64_t expand( const uint64_t value, const uint64_t reference ) const;
+
+    /* Copy out just the header (no payload) */
+    Header header() const { return Header( *this ); }
+
+    const char * payload() const { return data_ + header_size_; }
+    size_t payload_length() const { return length_ - header_size_; }
+  };
+
   std::string payload;
 
   /* New message */
@@ -33,6 +126,7 @@ struct ContestMessage
 
   /* Parse incoming datagram from wire */
   ContestMessage( const std::string & str );
+  ContestMessage( const char * data, const size_t length );
 
   /* Fill in the send_timestamp for an outgoing datagram */
   void set_send_timestamp();
@@ -1,89 +1,143 @@
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 #include "controller.hh"
+#include "controllers.hh"
 #include "timestamp.hh"
-#include <math.h>
-
-#define AIMD false 
-#define AIMD_INC 2
-#define AIMD_DEC 0.5
-
-#define DELAY_TRIGGERED false 
-#define DT_INC 1
-#define DT_DEC 10 
-#define DT_THRESHOLD 450  // in milliseconds
-#define PERIOD 2 // in milliseconds, time to wait before next increase
-
-#define COOL_ALG true
-#define TICK 20 // in ms
-#define MAX_RATE 200
-#define TICKS_PER_RTT 3.5 // was 3.5 
-#define PERCENTILE_LATENCY 0.01
-#define PACKETS_PER_BUCKET 20.0  // rename to INTERVAL_SIZE
-#define EWMA_WEIGHT 0.2 
-#define BROWNIAN_MOTION 200.0
-#define MIN_PROB 0.000001
-#define ZFACTOR 0.2 
-
-#define DEBUG false 
 
 using namespace std;
 
-// sum of 0 through max rate * TICKS_PER_RTT
-//double total_packets;
+/* parse "key=value,key=value,..." (or nothing) */
+Controller::Parameters::Parameters( const string & list )
+  : values_(), used_()
+{
+  istringstream items( list );
+  string item;
+  while ( getline( items, item, ',' ) ) {
+    const size_t equals = item.find( '=' );
+    if ( equals == string::npos or equals == 0 ) {
+      throw runtime_error( "controller parameter \"" + item + "\" is not KEY=VALUE" );
+    }
 
-// probability distributions
-double rate_probability[MAX_RATE];
+    const string key = item.substr( 0, equals ), value = item.substr( equals + 1 );
+    size_t parsed = 0;
+    try {
+      values_[ key ] = stod( value, &parsed );
+    } catch ( const logic_error & ) {
+      parsed = 0;
+    }
+    /* (stod() takes "nan" and "inf", which no parameter can use) */
+    if ( parsed == 0 or parsed != value.size() or not isfinite( values_[ key ] ) ) {
+      throw runtime_error( "controller parameter " + key + " has invalid value \"" + value + "\"" );
+    }
+  }
+}
 
+double Controller::Parameters::get( const string & key, const double default_value ) const
+{
+  used_.insert( key );
+  const auto it = values_.find( key );
+  return it == values_.end() ? default_value : it->second;
+}
 
-/* Default constructor */
-Controller::Controller( const bool debug )
-  : debug_( debug )
+unsigned int Controller::Parameters::get_count( const string & key, const unsigned int default_value,
+						const unsigned int maximum ) const
 {
-//  total_packets = 0;
-//  for (int i = 0; i < MAX_RATE; i++) {
-//    total_packets += i / PACKETS_PER_BUCKET * TICKS_PER_RTT;
-//  }
-  for (int i = 0; i < MAX_RATE; i++) {
-    rate_probability[i] = 1.0 / MAX_RATE;
+  const double value = get( key, default_value );
+  if ( value < 0 or value > maximum or value != static_cast<unsigned int>( value ) ) {
+    throw runtime_error( "controller parameter " + key + " must be a whole number no more than "
+			 + to_string( maximum ) );
   }
+  return value;
 }
 
-/* Default: fixed window size of 100 outstanding datagrams */
-unsigned int the_window_size = 20;
-
-unsigned int in_progress_window = 0;
-
-// last ack received, used for delay triggered
-uint64_t last_ack = 0;
-
-// last time window was updated, used for delay triggered
-uint64_t last_update = 0;
+/* throw if a key was given that no get() asked for */
+void Controller::Parameters::check_all_used() const
+{
+  for ( const auto & value : values_ ) {
+    if ( not used_.count( value.first ) ) {
+      throw runtime_error( "unknown controller parameter " + value.first );
+    }
+  }
+}
 
-// last tick time
-uint64_t last_tick = 0;
+/* The registry: every controller make() can build */
+typedef vector<unique_ptr<Controller>> Controllers;
 
-// acks received during tick
-uint64_t packets_in_tick = 0;
+struct ControllerType
+{
+  const char * name;
+  const char * parameters; /* and their defaults, for usage() */
+  function<Controllers( const bool, const Controller::Parameters &, const int )> make_flows;
+};
+
+/* independent controllers, one per flow */
+template <class T>
+static Controllers make_controllers( const bool debug, const Controller::Parameters & parameters, const int count )
+{
+  Controllers ret;
+  for ( int flow = 0; flow < count; flow++ ) {
+    ret.emplace_back( new T( debug, parameters ) );
+  }
+  return ret;
+}
 
-// acks received during previous tick
-uint64_t old_packets_in_tick = 0;
+static const ControllerType controller_types[] = {
+  { "cool", "window=20,tick_ms=20,buckets=200,packets_per_bucket=20,"
+    "brownian_motion=200,percentile=0.01,ewma=0.2,min_prob=1e-6",
+    CoolController::make_flows },
+  { "aimd", "window=20,increase=2,decrease=0.5", make_controllers<AIMDController> },
+  { "delay", "window=20,increase=1,decrease=10,threshold_ms=450", make_controllers<DelayTriggeredController> },
+  { "fixed", "window=20", make_controllers<FixedWindowController> },
+};
+
+/* Make controllers for count flows from a command-line spec, "NAME[:KEY=VALUE,...]" */
+Controllers Controller::make_flows( const string & spec, const bool debug, const int count )
+{
+  const size_t colon = spec.find( ':' );
+  const string name = spec.substr( 0, colon );
+  const Parameters parameters( colon == string::npos ? "" : spec.substr( colon + 1 ) );
+
+  for ( const auto & type : controller_types ) {
+    if ( name == type.name ) {
+      Controllers controllers = type.make_flows( debug, parameters, count );
+      parameters.check_all_used();
+      return controllers;
+    }
+  }
 
-uint64_t old2_packets_in_tick = 0;
+  throw runtime_error( "unknown controller " + name );
+}
 
-uint64_t retransmit_packets_in_tick = 0;
+unique_ptr<Controller> Controller::make( const string & spec, const bool debug )
+{
+  return move( make_flows( spec, debug, 1 ).front() );
+}
 
-// track last ackno received so don't double count packets
-uint64_t last_ackno = 0;
+string Controller::usage()
+{
+  string ret;
+  for ( const auto & type : controller_types ) {
+    ret += string( "  " ) + type.name + "[:" + type.parameters + "]\n";
+  }
+  return ret + "  (every controller also takes timeout_ms=1000; the first is the default)\n";
+}
 
-double time_elapsed = 0.0;
+Controller::Controller( const bool debug, const Parameters & parameters )
+  : debug_( debug ),
+    timeout_ms_( parameters.get_count( "timeout_ms", 1000 ) )
+{}
 
 /* Get current window size, in datagrams */
 unsigned int Controller::window_size()
 {
+  const unsigned int the_window_size = window();
 
   if ( debug_ ) {
-    cerr << "At time " << timestamp_ms()
+    cerr << "At time " << timestamp_us()
 	 << " window size is " << the_window_size << endl;
   }
 
@@ -94,23 +148,11 @@ unsigned int Controller::window_size()
 void Controller::datagram_was_sent( const uint64_t sequence_number,
 				    /* of the sent datagram */
 				    const uint64_t send_timestamp,
-                                    /* in milliseconds */
+                                    /* in microseconds */
 				    const bool after_timeout
 				    /* datagram was sent because of a timeout */ )
 {
-  /* Default: take no action */
-
-  if (AIMD) {
-    if (after_timeout) {
-      the_window_size = the_window_size*AIMD_DEC;
-    }
-  }
-
-  if (COOL_ALG) {
-    if (after_timeout) {
-      retransmit_packets_in_tick++;
-    }
-  }
+  sent( sequence_number, send_timestamp, after_timeout );
 
   if ( debug_ ) {
     cerr << "At time " << send_timestamp
@@ -118,15 +160,6 @@ void Controller::datagram_was_sent( const uint64_t sequence_number,
   }
 }
 
-uint64_t factorial(uint64_t n) {
-  if (n == 0) return 1;
-  return n*factorial(n-1);
-}
-
-double cdf(double mean, double stddev, double x) {
-  return 0.5 * erfc(-1 * (x - mean) / (stddev));
-}
-
 /* An ack was received */
 void Controller::ack_received( const uint64_t sequence_number_acked,
 			       /* what sequence number was acknowledged */
@@ -137,110 +170,8 @@ void Controller::ack_received( const uint64_t sequence_number_acked,
 			       const uint64_t timestamp_ack_received )
                                /* when the ack was received (by sender) */
 {
-  /* Default: take no action */
-
-  if (AIMD) {
-    in_progress_window += AIMD_INC;
-    if (in_progress_window >= the_window_size) {
-      the_window_size += 1;
-      in_progress_window = 0;
-    }
-  }
+  acked( sequence_number_acked, send_timestamp_acked, recv_timestamp_acked, timestamp_ack_received );
 
-  if (DELAY_TRIGGERED) {
-    uint64_t rtt = timestamp_ack_received - send_timestamp_acked;
-    if (rtt < DT_THRESHOLD && sequence_number_acked > last_ack) {
-         in_progress_window += DT_INC;
-         if (in_progress_window >= the_window_size) {
-           the_window_size += 1;
-           in_progress_window = 0;
-         }
-    } else {
-       uint64_t new_window_sz = the_window_size - DT_DEC;
-       the_window_size = new_window_sz < the_window_size ? new_window_sz : 0; // check for overflow
-    }
-    if (DEBUG) cerr << "new window sz: " << the_window_size << endl;
-  }
-  last_ack = sequence_number_acked > last_ack ? sequence_number_acked : last_ack;
- 
-  if (COOL_ALG) {
-    if (last_ackno != sequence_number_acked) {
-      packets_in_tick++;
-      last_ackno = sequence_number_acked;
-    }
-    if (timestamp_ack_received - last_tick >= TICK) {
-      // Tick has elapsed.
-      double sum = 0;
-      // Evolve rate probabilities.
-      if (time_elapsed != 0.0) {
-        double stddev = BROWNIAN_MOTION * sqrt(time_elapsed);
-        if (DEBUG) cout << "STDDEV: " << stddev << endl;
-         double new_rate_probability[MAX_RATE];
-         for (int i = 0; i < MAX_RATE; i++) {
-           new_rate_probability[i] = 0.0;
-         }
-         new_rate_probability[0] = max(rate_probability[0], MIN_PROB);
-         if (DEBUG) cout << "evolved rate probability[0] = " << rate_probability[0] << endl;
-         for (int new_rate = 1; new_rate < MAX_RATE; new_rate++) {
-           for (int old_rate = 1; old_rate < MAX_RATE; old_rate++) {
-             double mean = 0.0;
-	     double zfactor = 1.0;
-             if (old_rate == 0) {
-               zfactor = (new_rate != 0) ? ZFACTOR : 1 - ZFACTOR;
-             }
-             double val = cdf(mean, stddev, new_rate + (1.0 / PACKETS_PER_BUCKET) - old_rate) - cdf(mean, stddev, new_rate - old_rate);
-             new_rate_probability[new_rate] += rate_probability[old_rate] * val * zfactor;  // prevent -nan with 0 
-          }
-        }
-        for (int i = 0; i < MAX_RATE; i++) {
-          rate_probability[i] = new_rate_probability[i];
-        }
-      }
-      // Update rate probabilities. 
-      for (int i = 0; i < MAX_RATE; i++) {
-        // Calculating poisson
-        double p = pow((i / PACKETS_PER_BUCKET) * (TICK  / 1000.0), packets_in_tick);
-        p /= (double) factorial(packets_in_tick);
-        p *= exp(-1 * (i / PACKETS_PER_BUCKET) * (TICK / 1000.0));
-        rate_probability[i] = rate_probability[i] * p;
-        if (DEBUG) cerr << "rate_probability[" << i << "] = " << rate_probability[i] << endl;
-        sum += rate_probability[i];
-      }
-      if (DEBUG) cerr << "sum = " << sum << endl;
-      // Normalize rate probabilities. 
-      for (int i = 0; i < MAX_RATE; i++) {
-        rate_probability[i] = rate_probability[i] / sum;
-        if (DEBUG) cerr << "normalized rate_probability[" << i << "] = " << rate_probability[i] << endl;
-      }
-      // Set window size based on largest rate_probability value
-      sum = 0;
-      int i = 0;
-      while (sum < PERCENTILE_LATENCY && i < MAX_RATE) {
-        sum += rate_probability[i];
-        i++;
-      }
-//      uint64_t new_estimate = (i / PACKETS_PER_BUCKET) * TICKS_PER_RTT;
-//      double ewma;
-//      if (new_estimate < the_window_size) {
-//        ewma = 2.0 * EWMA_WEIGHT;
-//      } else {
-//        ewma = EWMA_WEIGHT;
-//      }
-//      the_window_size = (ewma * new_estimate) + ((1 - ewma) * the_window_size);
-      uint64_t new_estimate = (i / PACKETS_PER_BUCKET) + old_packets_in_tick + old2_packets_in_tick - retransmit_packets_in_tick;
-      the_window_size = EWMA_WEIGHT * (new_estimate) + ((1 - EWMA_WEIGHT) * the_window_size);
-      if (DEBUG) cerr << "new window sz: " << the_window_size << endl;
-      // 95th percentile just use lambda * 8 (TICK * 8 = RTT)     
-      // Reset for next period.
-      last_tick = timestamp_ack_received;
-      old_packets_in_tick = packets_in_tick;
-      old2_packets_in_tick = old_packets_in_tick;
-      packets_in_tick = 0;
-      retransmit_packets_in_tick = 0;
-      time_elapsed += TICK / 1000.0;
-    }
-  }
- 
   if ( debug_ ) {
     cerr << "At time " << timestamp_ack_received
 	 << " received ack for datagram " << sequence_number_acked
@@ -249,11 +180,3 @@ void Controller::ack_received( const uint64_t sequence_number_acked,
 	 << endl;
   }
 }
-
-
-/* How long to wait (in milliseconds) if there are no acks
-   before sending one more datagram */
-unsigned int Controller::timeout_ms()
-{
-  return 1000; /* timeout of one second */
-}
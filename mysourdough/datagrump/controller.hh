@@ -2,27 +2,85 @@
 #define CONTROLLER_HH
 
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 /* Congestion controller interface */
 
 class Controller
 {
+public:
+  /* key=value settings for a controller (from the command line) */
+  class Parameters
+  {
+  private:
+    std::map<std::string, double> values_;
+    mutable std::set<std::string> used_;
+
+  public:
+    /* parse "key=value,key=value,..." (or nothing) */
+    Parameters( const std::string & list );
+
+    /* the value of key, if it was given, else default_value */
+    double get( const std::string & key, const double default_value ) const;
+
+    /* same, for a value that must be a whole number (of datagrams, ms...)
+       no more than maximum */
+    unsigned int get_count( const std::string & key, const unsigned int default_value,
+			    const unsigned int maximum = std::numeric_limits<unsigned int>::max() ) const;
+
+    /* throw if a key was given that no get() asked for */
+    void check_all_used() const;
+  };
+
 private:
   bool debug_; /* Enables debugging output */
 
-  /* Add member variables here */
+  /* How long to wait (in milliseconds) if there are no acks
+     before sending one more datagram */
+  unsigned int timeout_ms_;
+
+  /* the algorithm, called by the public interface below */
+  virtual unsigned int window() = 0;
+  virtual void sent( const uint64_t sequence_number,
+		     const uint64_t send_timestamp,
+		     const bool after_timeout ) = 0;
+  virtual void acked( const uint64_t sequence_number_acked,
+		      const uint64_t send_timestamp_acked,
+		      const uint64_t recv_timestamp_acked,
+		      const uint64_t timestamp_ack_received ) = 0;
+
+protected:
+  Controller( const bool debug, const Parameters & parameters );
 
 public:
-  /* Public interface for the congestion controller */
-  /* You can change these if you prefer, but will need to change
-     the call site as well (in sender.cc) */
+  /* largest initial window= a controller takes (the sender keeps a
+     packet buffer for each datagram in the window) */
+  static const unsigned int MAX_WINDOW = 100000;
+
+  virtual ~Controller() {}
+
+  /* Make a controller from a command-line spec, "NAME[:KEY=VALUE,...]"
+     (see usage() for the names and their parameters) */
+  static std::unique_ptr<Controller> make( const std::string & spec, const bool debug );
 
-  /* Default constructor */
-  Controller( const bool debug );
+  /* Make one controller for each of count flows (controllers that keep
+     the state of many flows together, like cool, share it) */
+  static std::vector<std::unique_ptr<Controller>> make_flows( const std::string & spec,
+							      const bool debug, const int count );
+
+  /* the controllers make() knows, and their parameters */
+  static std::string usage();
 
   /* Get current window size, in datagrams */
   unsigned int window_size();
 
+  /* (all timestamps are in microseconds) */
+
   /* A datagram was sent */
   void datagram_was_sent( const uint64_t sequence_number,
 			  const uint64_t send_timestamp,
@@ -36,7 +94,11 @@ public:
 
   /* How long to wait (in milliseconds) if there are no acks
      before sending one more datagram */
-  unsigned int timeout_ms();
+  unsigned int timeout_ms() const { return timeout_ms_; }
+
+  /* forbid copying (implementations hold the state of a flow) */
+  Controller( const Controller & other ) = delete;
+  const Controller & operator=( const Controller & other ) = delete;
 };
 
 #endif
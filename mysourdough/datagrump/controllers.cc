@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "controllers.hh"
+
+using namespace std;
+
+FixedWindowController::FixedWindowController( const bool debug, const Parameters & parameters )
+  : Controller( debug, parameters ),
+    window_( parameters.get_count( "window", 20, MAX_WINDOW ) )
+{}
+
+AIMDController::AIMDController( const bool debug, const Parameters & parameters )
+  : Controller( debug, parameters ),
+    window_( parameters.get_count( "window", 20, MAX_WINDOW ) ),
+    in_progress_window_( 0 ),
+    increase_( parameters.get( "increase", 2 ) ),
+    decrease_( parameters.get( "decrease", 0.5 ) )
+{}
+
+/* halve (by default) the window on every timeout */
+void AIMDController::sent( const uint64_t, const uint64_t, const bool after_timeout )
+{
+  if ( after_timeout ) {
+    window_ = window_ * decrease_;
+  }
+}
+
+/* one more datagram after every window / increase acks */
+void AIMDController::acked( const uint64_t, const uint64_t, const uint64_t, const uint64_t )
+{
+  in_progress_window_ += increase_;
+  if ( in_progress_window_ >= window_ ) {
+    window_ += 1;
+    in_progress_window_ = 0;
+  }
+}
+
+DelayTriggeredController::DelayTriggeredController( const bool debug, const Parameters & parameters )
+  : Controller( debug, parameters ),
+    window_( parameters.get_count( "window", 20, MAX_WINDOW ) ),
+    in_progress_window_( 0 ),
+    last_ack_( 0 ),
+    increase_( parameters.get_count( "increase", 1 ) ),
+    decrease_( parameters.get_count( "decrease", 10 ) ),
+    threshold_us_( parameters.get_count( "threshold_ms", 450 ) * uint64_t( 1000 ) )
+{}
+
+void DelayTriggeredController::acked( const uint64_t sequence_number_acked,
+				      const uint64_t send_timestamp_acked,
+				      const uint64_t,
+				      const uint64_t timestamp_ack_received )
+{
+  const uint64_t rtt = timestamp_ack_received - send_timestamp_acked;
+
+  if ( rtt < threshold_us_ and sequence_number_acked > last_ack_ ) {
+    in_progress_window_ += increase_;
+    if ( in_progress_window_ >= window_ ) {
+      window_ += 1;
+      in_progress_window_ = 0;
+    }
+  } else {
+    /* (no lower than zero) */
+    window_ = window_ > decrease_ ? window_ - decrease_ : 0;
+  }
+
+  last_ack_ = max( last_ack_, sequence_number_acked );
+}
+
+CoolController::CoolController( const bool debug, const Parameters & parameters,
+				const shared_ptr<CoolFlows> & flows, const int flow )
+  : Controller( debug, parameters ),
+    flows_( flows ),
+    flow_( flow )
+{}
+
+vector<unique_ptr<Controller>> CoolController::make_flows( const bool debug,
+							   const Parameters & parameters,
+							   const int count )
+{
+  const auto flows = make_shared<CoolFlows>( parameters, count );
+
+  vector<unique_ptr<Controller>> ret;
+  for ( int flow = 0; flow < count; flow++ ) {
+    ret.emplace_back( new CoolController( debug, parameters, flows, flow ) );
+  }
+  return ret;
+}
+
+void CoolController::sent( const uint64_t, const uint64_t, const bool after_timeout )
+{
+  flows_->sent( flow_, after_timeout );
+}
+
+void CoolController::acked( const uint64_t sequence_number_acked,
+			    const uint64_t,
+			    const uint64_t,
+			    const uint64_t timestamp_ack_received )
+{
+  flows_->acked( flow_, sequence_number_acked, timestamp_ack_received );
+}
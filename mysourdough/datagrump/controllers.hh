@@ -0,0 +1,102 @@
+#ifndef CONTROLLERS_HH
+#define CONTROLLERS_HH
+
+#include <memory>
+#include <vector>
+
+#include "controller.hh"
+#include "cool_flows.hh"
+
+/* The congestion controllers Controller::make() can build. Each one's
+   parameters (and their defaults) are listed by Controller::usage(). */
+
+/* A window that never changes */
+class FixedWindowController : public Controller
+{
+private:
+  unsigned int window_;
+
+  unsigned int window() override { return window_; }
+  void sent( const uint64_t, const uint64_t, const bool ) override {}
+  void acked( const uint64_t, const uint64_t, const uint64_t, const uint64_t ) override {}
+
+public:
+  FixedWindowController( const bool debug, const Parameters & parameters );
+};
+
+/* Additive increase (by one datagram after every window / increase
+   acks), multiplicative decrease on every timeout */
+class AIMDController : public Controller
+{
+private:
+  unsigned int window_;
+  double in_progress_window_;
+
+  double increase_, decrease_;
+
+  unsigned int window() override { return window_; }
+  void sent( const uint64_t sequence_number,
+	     const uint64_t send_timestamp,
+	     const bool after_timeout ) override;
+  void acked( const uint64_t sequence_number_acked,
+	      const uint64_t send_timestamp_acked,
+	      const uint64_t recv_timestamp_acked,
+	      const uint64_t timestamp_ack_received ) override;
+
+public:
+  AIMDController( const bool debug, const Parameters & parameters );
+};
+
+/* Additive increase while the RTT is under a threshold, and a fixed
+   decrease for every ack over it (or out of order) */
+class DelayTriggeredController : public Controller
+{
+private:
+  unsigned int window_;
+  unsigned int in_progress_window_;
+
+  /* highest sequence number acked so far */
+  uint64_t last_ack_;
+
+  unsigned int increase_, decrease_;
+  uint64_t threshold_us_;
+
+  unsigned int window() override { return window_; }
+  void sent( const uint64_t, const uint64_t, const bool ) override {}
+  void acked( const uint64_t sequence_number_acked,
+	      const uint64_t send_timestamp_acked,
+	      const uint64_t recv_timestamp_acked,
+	      const uint64_t timestamp_ack_received ) override;
+
+public:
+  DelayTriggeredController( const bool debug, const Parameters & parameters );
+};
+
+/* The Bayesian rate estimator (see CoolFlows): one flow of a set
+   whose state is kept, and updated, together */
+class CoolController : public Controller
+{
+private:
+  std::shared_ptr<CoolFlows> flows_;
+  int flow_;
+
+  unsigned int window() override { return flows_->window( flow_ ); }
+  void sent( const uint64_t sequence_number,
+	     const uint64_t send_timestamp,
+	     const bool after_timeout ) override;
+  void acked( const uint64_t sequence_number_acked,
+	      const uint64_t send_timestamp_acked,
+	      const uint64_t recv_timestamp_acked,
+	      const uint64_t timestamp_ack_received ) override;
+
+public:
+  CoolController( const bool debug, const Parameters & parameters,
+		  const std::shared_ptr<CoolFlows> & flows, const int flow );
+
+  /* a controller for each of count flows, sharing one CoolFlows */
+  static std::vector<std::unique_ptr<Controller>> make_flows( const bool debug,
+							      const Parameters & parameters,
+							      const int count );
+};
+
+#endif /* CONTROLLERS_HH */
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "cool_flows.hh"
+
+using namespace std;
+
+/* most buckets a rate distribution may have: the finest grid
+   TransitionKernel's FFT path was built for, which it evolves in a few
+   milliseconds per tick (n log n; a finer one would take most of a tick) */
+static const unsigned int MAX_BUCKETS = 16384;
+
+CoolFlows::CoolFlows( const Controller::Parameters & parameters, const int flows )
+  : flows_( flows ),
+    buckets_( parameters.get_count( "buckets", 200, MAX_BUCKETS ) ),
+    packets_per_bucket_( parameters.get( "packets_per_bucket", 20 ) ),
+    tick_us_( parameters.get_count( "tick_ms", 20 ) * uint64_t( 1000 ) ),
+    brownian_motion_( parameters.get( "brownian_motion", 200 ) ),
+    percentile_( parameters.get( "percentile", 0.01 ) ),
+    ewma_weight_( parameters.get( "ewma", 0.2 ) ),
+    min_probability_( parameters.get( "min_prob", 1e-6 ) ),
+    kernels_(),
+    spare_kernels_(),
+    poisson_likelihood_( buckets_, (1.0 / packets_per_bucket_) * (tick_us_ / 1e6) ),
+    rate_probability_( size_t( buckets_ ) * flows, 1.0 / buckets_ ),
+    new_rate_probability_( buckets_ ),
+    window_( flows, parameters.get_count( "window", 20, Controller::MAX_WINDOW ) ),
+    packets_in_tick_( flows ),
+    old_packets_in_tick_( flows ),
+    old2_packets_in_tick_( flows ),
+    retransmit_packets_in_tick_( flows ),
+    last_ackno_( flows ),
+    last_tick_( flows ),
+    ticks_( flows )
+{
+  if ( flows < 1 or buckets_ < 2 or tick_us_ == 0 or packets_per_bucket_ <= 0 ) {
+    throw runtime_error( "cool: needs flows >= 1, buckets >= 2, tick_ms > 0 and packets_per_bucket > 0" );
+  }
+
+  /* every flow starts at zero ticks */
+  kernels_[ 0 ].flows = flows_;
+}
+
+void CoolFlows::sent( const int flow, const bool after_timeout )
+{
+  if ( after_timeout ) {
+    retransmit_packets_in_tick_[ flow ]++;
+  }
+}
+
+void CoolFlows::acked( const int flow, const uint64_t sequence_number_acked,
+		       const uint64_t timestamp_ack_received )
+{
+  if ( last_ackno_[ flow ] != sequence_number_acked ) {
+    packets_in_tick_[ flow ]++;
+    last_ackno_[ flow ] = sequence_number_acked;
+  }
+
+  if ( timestamp_ack_received >= last_tick_[ flow ] + tick_us_ ) {
+    tick( flow, timestamp_ack_received );
+  }
+}
+
+/* the evolution weights after ticks ticks (computed by the first flow
+   to need them, in a spare kernel if there is one) */
+TransitionKernel & CoolFlows::kernel( const uint64_t ticks )
+{
+  Kernel & shared = kernels_[ ticks ];
+  if ( not shared.kernel ) {
+    if ( spare_kernels_.empty() ) {
+      shared.kernel.reset( new TransitionKernel( buckets_, 1.0 / packets_per_bucket_ ) );
+    } else {
+      shared.kernel = move( spare_kernels_.back() );
+      spare_kernels_.pop_back();
+    }
+    shared.kernel->set_stddev( brownian_motion_ * sqrt( ticks * (tick_us_ / 1e6) ) );
+  }
+
+  return *shared.kernel;
+}
+
+/* a flow's tick count goes from ticks to ticks + 1 (the kernel for
+   ticks goes spare once no flow is left to use it) */
+void CoolFlows::next_kernel( const uint64_t ticks )
+{
+  const auto it = kernels_.find( ticks );
+  if ( --it->second.flows == 0 ) {
+    if ( it->second.kernel ) {
+      spare_kernels_.push_back( move( it->second.kernel ) );
+    }
+    kernels_.erase( it );
+  }
+
+  kernels_[ ticks + 1 ].flows++;
+}
+
+void CoolFlows::tick( const int flow, const uint64_t timestamp )
+{
+  double * const row = &rate_probability_[ size_t( flow ) * buckets_ ];
+
+  /* evolve the rate probabilities (bucket 0 keeps its probability,
+     but never less than min_prob, so the rate can always fall to zero) */
+  if ( ticks_[ flow ] != 0 ) {
+    new_rate_probability_[ 0 ] = max( row[ 0 ], min_probability_ );
+    kernel( ticks_[ flow ] ).apply( row, new_rate_probability_.data() );
+    copy( new_rate_probability_.begin(), new_rate_probability_.end(), row );
+  }
+
+  /* update by the Poisson likelihood of this tick's acks, and normalize
+     (in log space, so no ack count can overflow or underflow) */
+  poisson_likelihood_.update( row, packets_in_tick_[ flow ] );
+
+  /* the window follows the rate at the given percentile */
+  double sum = 0;
+  int i = 0;
+  while ( sum < percentile_ and i < buckets_ ) {
+    sum += row[ i ];
+    i++;
+  }
+
+  const double new_estimate = (i / packets_per_bucket_)
+    + old_packets_in_tick_[ flow ] + old2_packets_in_tick_[ flow ] - retransmit_packets_in_tick_[ flow ];
+  window_[ flow ] = min( ewma_weight_ * max( new_estimate, 0.0 ) + (1 - ewma_weight_) * window_[ flow ],
+			 double( Controller::MAX_WINDOW ) );
+
+  /* reset for the next tick (both earlier counts take this tick's) */
+  last_tick_[ flow ] = timestamp;
+  old_packets_in_tick_[ flow ] = packets_in_tick_[ flow ];
+  old2_packets_in_tick_[ flow ] = old_packets_in_tick_[ flow ];
+  packets_in_tick_[ flow ] = 0;
+  retransmit_packets_in_tick_[ flow ] = 0;
+  next_kernel( ticks_[ flow ] );
+  ticks_[ flow ]++;
+}
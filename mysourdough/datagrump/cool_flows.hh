@@ -0,0 +1,100 @@
+#ifndef COOL_FLOWS_HH
+#define COOL_FLOWS_HH
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "controller.hh"
+#include "transition_kernel.hh"
+#include "poisson_likelihood.hh"
+
+/* The state of the Bayesian ("cool") controller for a set of flows,
+   kept together so the flows share their working memory.
+
+   For each flow, a distribution over the link rate (in buckets of
+   1 / packets_per_bucket datagrams per millisecond) diffuses by Brownian
+   motion and is updated by the Poisson likelihood of the tick's acks;
+   the window follows a low percentile of the rate, smoothed by an EWMA.
+
+   Each flow ticks on its own clock (a tick ends at the flow's first ack
+   at least tick_ms after its last tick), exactly as a lone controller
+   would, so one ack costs at most one flow's update. The evolution's
+   stddev grows with the flow's own number of ticks, so the weights are
+   kept for each tick count that some flow has yet to tick at: the first
+   flow to get there computes them, the rest reuse them, and they go once
+   the last flow moves on. The distributions are rows of one array, and
+   the per-flow counters and windows are arrays of their own. */
+class CoolFlows
+{
+private:
+  int flows_;
+
+  int buckets_;
+  double packets_per_bucket_;
+  uint64_t tick_us_;
+  double brownian_motion_;
+  double percentile_;
+  double ewma_weight_;
+  double min_probability_;
+
+  /* the evolution step for each tick count flows are at: how many
+     flows are, and the weights (once one of them has ticked) */
+  struct Kernel
+  {
+    int flows;
+    std::unique_ptr<TransitionKernel> kernel;
+
+    Kernel() : flows( 0 ), kernel() {}
+  };
+  std::map<uint64_t, Kernel> kernels_;
+
+  /* kernels no tick count needs any more, to reuse */
+  std::vector<std::unique_ptr<TransitionKernel>> spare_kernels_;
+
+  /* the update step */
+  PoissonLikelihood poisson_likelihood_;
+
+  /* flow f's distribution is rate_probability_[ f * buckets_ ] on */
+  std::vector<double> rate_probability_;
+
+  /* scratch space for one flow's evolution */
+  std::vector<double> new_rate_probability_;
+
+  /* per flow: */
+  std::vector<unsigned int> window_;
+
+  /* acks received during this tick and the two before, and datagrams
+     sent after a timeout during this tick */
+  std::vector<uint64_t> packets_in_tick_, old_packets_in_tick_, old2_packets_in_tick_;
+  std::vector<uint64_t> retransmit_packets_in_tick_;
+
+  /* so a repeated ack isn't counted twice */
+  std::vector<uint64_t> last_ackno_;
+
+  /* start of the current tick, and ticks so far */
+  std::vector<uint64_t> last_tick_, ticks_;
+
+  /* the evolution weights after ticks ticks */
+  TransitionKernel & kernel( const uint64_t ticks );
+
+  /* a flow's tick count goes from ticks to ticks + 1 */
+  void next_kernel( const uint64_t ticks );
+
+  /* evolve, update, and set the window of one flow */
+  void tick( const int flow, const uint64_t timestamp );
+
+public:
+  CoolFlows( const Controller::Parameters & parameters, const int flows );
+
+  int flows() const { return flows_; }
+
+  unsigned int window( const int flow ) const { return window_[ flow ]; }
+
+  void sent( const int flow, const bool after_timeout );
+  void acked( const int flow, const uint64_t sequence_number_acked,
+	      const uint64_t timestamp_ack_received );
+};
+
+#endif /* COOL_FLOWS_HH */
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "fft.hh"
+
+using namespace std;
+
+FFT::FFT( const size_t size )
+  : size_( size ),
+    bit_reversed_( size ),
+    cos_( size / 2 ),
+    sin_( size / 2 )
+{
+  if ( size < 2 or (size & (size - 1)) ) {
+    throw runtime_error( "FFT size must be a power of two" );
+  }
+
+  int bits = 0;
+  while ( (size_t( 1 ) << bits) < size ) {
+    bits++;
+  }
+
+  for ( size_t i = 0; i < size; i++ ) {
+    size_t reversed = 0;
+    for ( int bit = 0; bit < bits; bit++ ) {
+      reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+    }
+    bit_reversed_[ i ] = reversed;
+  }
+
+  for ( size_t k = 0; k < size / 2; k++ ) {
+    cos_[ k ] = cos( 2 * M_PI * k / size );
+    sin_[ k ] = sin( 2 * M_PI * k / size );
+  }
+}
+
+/* X[ f ] = sum over t of x[ t ] * exp( -2 pi i f t / size ) */
+void FFT::forward( double * real, double * imaginary ) const
+{
+  for ( size_t i = 0; i < size_; i++ ) {
+    if ( i < bit_reversed_[ i ] ) {
+      swap( real[ i ], real[ bit_reversed_[ i ] ] );
+      swap( imaginary[ i ], imaginary[ bit_reversed_[ i ] ] );
+    }
+  }
+
+  for ( size_t length = 2; length <= size_; length *= 2 ) {
+    const size_t half = length / 2, stride = size_ / length;
+
+    for ( size_t start = 0; start < size_; start += length ) {
+      double * const top_real = real + start, * const top_imaginary = imaginary + start;
+      double * const bottom_real = top_real + half, * const bottom_imaginary = top_imaginary + half;
+
+      for ( size_t j = 0; j < half; j++ ) {
+	/* bottom times exp( -2 pi i j / length ) */
+	const double w_real = cos_[ j * stride ], w_imaginary = -sin_[ j * stride ];
+	const double x_real = bottom_real[ j ] * w_real - bottom_imaginary[ j ] * w_imaginary;
+	const double x_imaginary = bottom_real[ j ] * w_imaginary + bottom_imaginary[ j ] * w_real;
+
+	bottom_real[ j ] = top_real[ j ] - x_real;
+	bottom_imaginary[ j ] = top_imaginary[ j ] - x_imaginary;
+	top_real[ j ] += x_real;
+	top_imaginary[ j ] += x_imaginary;
+      }
+    }
+  }
+}
+
+/* the inverse, including the division by size */
+void FFT::inverse( double * real, double * imaginary ) const
+{
+  /* swapping the parts conjugates (up to a factor of i), so the forward
+     transform of the swapped input is the swapped inverse */
+  forward( imaginary, real );
+
+  const double scale = 1.0 / size_;
+  for ( size_t i = 0; i < size_; i++ ) {
+    real[ i ] *= scale;
+    imaginary[ i ] *= scale;
+  }
+}
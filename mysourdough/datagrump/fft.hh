@@ -0,0 +1,30 @@
+#ifndef FFT_HH
+#define FFT_HH
+
+#include <cstddef>
+#include <vector>
+
+/* In-place radix-2 fast Fourier transform of a fixed power-of-two size,
+   with the real and imaginary parts in separate arrays (plain double
+   arithmetic, so the butterflies don't go through std::complex's
+   NaN-checking multiply and the compiler can vectorize them) */
+class FFT
+{
+private:
+  size_t size_;
+  std::vector<size_t> bit_reversed_; /* where each element goes before the butterflies */
+  std::vector<double> cos_, sin_; /* of 2 pi k / size, for k < size / 2 */
+
+public:
+  FFT( const size_t size );
+
+  size_t size() const { return size_; }
+
+  /* X[ f ] = sum over t of x[ t ] * exp( -2 pi i f t / size ) */
+  void forward( double * real, double * imaginary ) const;
+
+  /* the inverse, including the division by size */
+  void inverse( double * real, double * imaginary ) const;
+};
+
+#endif /* FFT_HH */
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "poisson_likelihood.hh"
+
+using namespace std;
+
+PoissonLikelihood::PoissonLikelihood( const int buckets, const double step )
+  : step_( step ),
+    log_bucket_( buckets ),
+    log_posterior_( buckets )
+{
+  if ( buckets < 1 ) {
+    throw runtime_error( "PoissonLikelihood needs at least one bucket" );
+  }
+
+  for ( int i = 0; i < buckets; i++ ) {
+    log_bucket_[ i ] = log( double( i ) );
+  }
+}
+
+/* multiply probability by the likelihood of count acks, and normalize */
+void PoissonLikelihood::update( double * probability, const uint64_t count )
+{
+  const int buckets = log_bucket_.size();
+  const double k = count;
+
+  /* log prior plus log likelihood (up to a constant); the rate-zero
+     bucket can only have produced zero acks */
+  log_posterior_[ 0 ] = count == 0 ? log( probability[ 0 ] ) : -numeric_limits<double>::infinity();
+  for ( int i = 1; i < buckets; i++ ) {
+    log_posterior_[ i ] = log( probability[ i ] ) + k * log_bucket_[ i ] - i * step_;
+  }
+
+  /* log-sum-exp: scale so the likeliest bucket is exp( 0 ) = 1 */
+  const double largest = *max_element( log_posterior_.begin(), log_posterior_.end() );
+  if ( not isfinite( largest ) ) { /* nothing is possible (or everything is certain): start over */
+    fill( probability, probability + buckets, 1.0 / buckets );
+    return;
+  }
+
+  double sum = 0;
+  for ( int i = 0; i < buckets; i++ ) {
+    probability[ i ] = exp( log_posterior_[ i ] - largest );
+    sum += probability[ i ];
+  }
+
+  for ( int i = 0; i < buckets; i++ ) {
+    probability[ i ] /= sum;
+  }
+}
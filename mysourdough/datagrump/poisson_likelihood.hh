@@ -0,0 +1,34 @@
+#ifndef POISSON_LIKELIHOOD_HH
+#define POISSON_LIKELIHOOD_HH
+
+#include <cstdint>
+#include <vector>
+
+/* The controller's Bayesian update for the number of acks seen in a
+   tick, done in log space so it holds up at any ack count.
+
+   If bucket i means an expected i * step acks per tick, the chance of
+   seeing k of them is ( i * step )^k / k! * exp( -i * step ). In log
+   space, log( k! ) and k * log( step ) are the same for every bucket,
+   so they cancel when the distribution is normalized, which leaves
+   k * log( i ) - i * step: one multiply-add per bucket against a table
+   of log( i ), with no factorial, pow() or lgamma(). Normalizing with
+   log-sum-exp (subtracting the largest log-probability before going
+   back to linear space) keeps the sum from overflowing or underflowing,
+   however sharply the likelihood peaks. */
+class PoissonLikelihood
+{
+private:
+  double step_;
+  std::vector<double> log_bucket_; /* log( i ), with log( 0 ) = -infinity */
+  std::vector<double> log_posterior_; /* scratch space for update() */
+
+public:
+  PoissonLikelihood( const int buckets, const double step );
+
+  /* multiply probability (one entry per bucket) by the likelihood of
+     count acks, and normalize it to sum to one */
+  void update( double * probability, const uint64_t count );
+};
+
+#endif /* POISSON_LIKELIHOOD_HH */
@@ -2,11 +2,139 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
 
 #include "socket.hh"
 #include "contest_message.hh"
+#include "timestamp.hh"
+#include "uring_engine.hh"
+#include "util.hh"
 
 using namespace std;
+using namespace PollerShortNames;
+
+/* most threads= (each has a socket on the port) */
+static const unsigned int MAX_THREADS = 1024;
+
+/* most datagrams to pull from the kernel per syscall */
+static const size_t RECV_BATCH_SIZE = 32;
+
+/* write the wire representation of an incoming datagram's ack
+   into ack (reused, so acknowledging doesn't allocate) */
+static void make_ack( const UDPSocket::datagram_view & recd,
+		      const uint64_t sequence_number,
+		      string & ack )
+{
+  const ContestMessage::View message( recd.payload, recd.payload_length );
+
+  /* assemble the acknowledgment */
+  ContestMessage::Header header = message.header();
+  header.transform_into_ack( sequence_number, recd.timestamp_ns / 1000,
+			     message.payload_length() );
+
+  /* timestamp the ack just before sending */
+  header.send_timestamp = timestamp_us();
+
+  ack.resize( header.wire_size() );
+  header.write( &ack[ 0 ] );
+}
+
+/* acknowledge every datagram that arrives on socket, forever */
+static int serve( UDPSocket & socket, const bool uring )
+{
+  /* each socket (and thread) keeps its own ack sequence numbers */
+  uint64_t sequence_number = 0;
+  string ack;
+
+  if ( uring ) {
+    /* keep a receive armed on an io_uring and queue the acks on it */
+    URingEngine engine;
+    engine.add_receive_action( socket, [&] ( const UDPSocket::datagram_view & recd ) {
+	make_ack( recd, sequence_number++, ack );
+	engine.sendto( socket, recd.source_address, ack.data(), ack.size() );
+	return ResultType::Continue;
+      } );
+
+    while ( true ) {
+      const auto ret = engine.wait( -1 );
+      if ( ret.result == PollResult::Exit ) {
+	return ret.exit_status;
+      }
+    }
+  }
+
+  /* reused for every receive so the loop doesn't allocate */
+  UDPSocket::ReceiveBuffer buffer( RECV_BATCH_SIZE );
+
+  /* Loop and acknowledge every incoming datagram back to its source */
+  while ( true ) {
+    socket.recv_batch( buffer );
+    for ( const auto & recd : buffer ) {
+      make_ack( recd, sequence_number++, ack );
+      socket.sendto( recd.source_address, ack );
+    }
+  }
+}
+
+/* open a socket on port (shared with the other threads' sockets if reuseport) */
+static void open_socket( UDPSocket & socket, const string & port,
+			 const bool reuseport, const bool timestamping )
+{
+  /* turn on timestamps on receipt (nanosecond, with SO_TIMESTAMPING) */
+  if ( timestamping ) {
+    socket.set_timestamping( false ); /* nothing here reads transmit timestamps */
+  } else {
+    socket.set_timestamps();
+  }
+
+  /* let the kernel coalesce runs of datagrams, if it can */
+  try {
+    socket.set_gro();
+  } catch ( const unix_error & e ) {
+    cerr << "Not using UDP GRO: " << e.what() << endl;
+  }
+
+  /* let the kernel hash flows across several sockets on the same port */
+  if ( reuseport ) {
+    socket.set_reuseport();
+  }
+
+  /* "bind" the socket to the user-specified local port number */
+  socket.bind( Address( "::0", port ) );
+}
+
+/* the cores this process may run on (e.g. under taskset or a cgroup) */
+static vector<unsigned int> allowed_cores()
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  SystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( cpus ), &cpus ) );
+
+  vector<unsigned int> cores;
+  for ( unsigned int core = 0; core < CPU_SETSIZE; core++ ) {
+    if ( CPU_ISSET( core, &cpus ) ) {
+      cores.push_back( core );
+    }
+  }
+  return cores;
+}
+
+/* keep the calling thread on one core */
+static void pin_to_core( const unsigned int core )
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( core, &cpus );
+
+  const int ret = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+  if ( ret ) {
+    throw unix_error( "pthread_setaffinity_np", ret );
+  }
+}
 
 int main( int argc, char *argv[] )
 {
@@ -15,37 +143,70 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  bool uring = false, timestamping = false;
+  unsigned int thread_count = 1;
+  for ( int i = 2; i < argc; i++ ) {
+    const string arg { argv[ i ] };
+    if ( arg == "uring" ) {
+      uring = true;
+    } else if ( arg == "timestamping" ) {
+      timestamping = true;
+    } else if ( arg.substr( 0, 8 ) == "threads=" ) {
+      if ( not parse_unsigned( arg.substr( 8 ), thread_count )
+	   or thread_count < 1 or thread_count > MAX_THREADS ) {
+	argc = 0; /* print usage */
+      }
+    } else {
+      argc = 0; /* print usage */
+    }
+  }
+
+  if ( argc < 2 ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT [uring] [threads=N] [timestamping]" << endl;
     return EXIT_FAILURE;
   }
 
-  /* create UDP socket for incoming datagrams */
-  UDPSocket socket;
+  const string port { argv[ 1 ] };
 
-  /* turn on timestamps on receipt */
-  socket.set_timestamps();
+  if ( thread_count == 1 ) {
+    /* create UDP socket for incoming datagrams */
+    UDPSocket socket;
+    open_socket( socket, port, false, timestamping );
 
-  /* "bind" the socket to the user-specified local port number */
-  socket.bind( Address( "::0", argv[ 1 ] ) );
+    cerr << "Listening on " << socket.local_address().to_string() << endl;
 
-  cerr << "Listening on " << socket.local_address().to_string() << endl;
+    return serve( socket, uring );
+  }
 
-  uint64_t sequence_number = 0;
+  /* one SO_REUSEPORT socket per thread, each thread pinned to one of
+     the cores the process is allowed */
+  const vector<unsigned int> cores = allowed_cores();
+  vector<thread> threads;
 
-  /* Loop and acknowledge every incoming datagram back to its source */
-  while ( true ) {
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
+  for ( unsigned int i = 0; i < thread_count; i++ ) {
+    const unsigned int core = cores.at( i % cores.size() );
+    threads.emplace_back( [&port, uring, timestamping, core] () {
+	try {
+	  try {
+	    pin_to_core( core );
+	  } catch ( const exception & e ) { /* still worth running unpinned */
+	    cerr << "Not pinning thread to core " << core << ": " << e.what() << endl;
+	  }
 
-    /* assemble the acknowledgment */
-    message.transform_into_ack( sequence_number++, recd.timestamp );
+	  UDPSocket socket;
+	  open_socket( socket, port, true, timestamping );
+	  serve( socket, uring );
+	} catch ( const exception & e ) { /* a thread can't carry on alone */
+	  print_exception( e );
+	  exit( EXIT_FAILURE );
+	}
+      } );
+  }
 
-    /* timestamp the ack just before sending */
-    message.set_send_timestamp();
+  cerr << "Listening on port " << port << " with " << thread_count << " threads" << endl;
 
-    /* send the ack */
-    socket.sendto( recd.source_address, message.to_string() );
+  for ( auto & t : threads ) {
+    t.join();
   }
 
   return EXIT_SUCCESS;
@@ -1,22 +1,44 @@
 /* UDP sender for congestion-control contest */
 
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
 
 #include "socket.hh"
 #include "contest_message.hh"
 #include "controller.hh"
 #include "poller.hh"
+#include "resolver.hh"
+#include "timer.hh"
+#include "timestamp.hh"
+#include "uring_engine.hh"
+#include "util.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* most acks to pull from the kernel per syscall */
+static const size_t RECV_BATCH_SIZE = 32;
+
+/* most flows= one sender process will drive (each has a socket) */
+static const unsigned int MAX_FLOWS = 65536;
+
+/* fewest flows for which the epoll backend beats poll() (which looks at
+   every fd on each wakeup; see benchmarks/poller_benchmark) */
+static const unsigned int EPOLL_MIN_FLOWS = 16;
+
+/* All messages use the same dummy payload, of this size */
+static const size_t PAYLOAD_SIZE = 1424;
+
 /* simple sender class to handle the accounting */
 class DatagrumpSender
 {
 private:
   UDPSocket socket_;
-  Controller controller_; /* your class */
+  UDPSocket::ReceiveBuffer ack_buffer_; /* reused for every batch of acks */
+  std::unique_ptr<Controller> controller_; /* your class (see Controller::make) */
 
   uint64_t sequence_number_; /* next outgoing sequence number */
 
@@ -25,16 +47,72 @@ private:
      next expects will be acknowledged by the receiver */
   uint64_t next_ack_expected_;
 
+  /* when the sender last heard an ack (or gave up waiting for one) */
+  uint64_t idle_since_;
+
+  /* packet buffers reused for every burst (the payload is written once;
+     only the header changes) */
+  std::vector<std::string> packets_;
+
+  /* use the compact header (and the last receive time the receiver
+     reported, to expand its 32-bit timestamps against; -1 until the
+     first ack, which starts the sender's view of the receiver's clock) */
+  bool compact_;
+  uint64_t last_ack_recv_timestamp_;
+
+  /* with SO_TIMESTAMPING, the controller hears about a datagram
+     only once the kernel reports when it actually left */
+  struct unstamped_datagram {
+    uint32_t tx_id;
+    uint64_t sequence_number;
+    bool after_timeout;
+  };
+
+  bool timestamping_;
+  std::deque<unstamped_datagram> unstamped_;
+
+  /* fires if no ack has arrived for the controller's timeout */
+  Timer idle_timer_;
+
+  /* the poller action that sends (see add_actions) */
+  size_t send_action_;
+
   void send_datagram( const bool after_timeout );
-  void got_ack( const uint64_t timestamp, const ContestMessage & msg );
+  void send_burst( const std::function<std::vector<uint32_t>( const size_t )> & transmit );
+  void write_packets( const uint64_t first_sequence_number, const size_t count,
+		      const uint64_t send_timestamp );
+  void datagram_was_sent( const uint32_t tx_id, const uint64_t sequence_number,
+			  const uint64_t send_timestamp, const bool after_timeout );
+  void got_tx_timestamps();
+  void got_ack( const uint64_t timestamp, const ContestMessage::View & ack );
+  void got_acks( const UDPSocket::ReceiveBuffer & acks );
+  void idle_timer_expired();
   bool window_is_open();
+  void update_send_interest( Poller & poller );
 
 public:
-  DatagrumpSender( const char * const host, const char * const port,
-		   const bool debug );
+  DatagrumpSender( const Address & receiver,
+		   std::unique_ptr<Controller> && controller,
+		   const bool timestamping, const bool compact );
+
+  /* add the rules of loop() to a poller (which may serve other senders too) */
+  void add_actions( Poller & poller );
+
   int loop();
+  int loop_uring();
 };
 
+/* Run a poller's rules forever */
+static int run( Poller & poller )
+{
+  while ( true ) {
+    const auto ret = poller.poll( -1 );
+    if ( ret.result == PollResult::Exit ) {
+      return ret.exit_status;
+    }
+  }
+}
+
 int main( int argc, char *argv[] )
 {
    /* check the command-line arguments */
@@ -42,109 +120,360 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  bool debug = false;
-  if ( argc == 4 and string( argv[ 3 ] ) == "debug" ) {
-    debug = true;
-  } else if ( argc == 3 ) {
-    /* do nothing */
-  } else {
-    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug]" << endl;
+  bool debug = false, uring = false, timestamping = false, compact = false;
+  string controller_spec = "cool";
+  unsigned int flows = 1;
+  for ( int i = 3; i < argc; i++ ) {
+    const string argument = argv[ i ], controller_prefix = "controller=", flows_prefix = "flows=";
+    if ( argument.compare( 0, controller_prefix.size(), controller_prefix ) == 0 ) {
+      controller_spec = argument.substr( controller_prefix.size() );
+    } else if ( argument.compare( 0, flows_prefix.size(), flows_prefix ) == 0 ) {
+      if ( not parse_unsigned( argument.substr( flows_prefix.size() ), flows ) ) {
+	argc = 0; /* print usage */
+      }
+    } else if ( string( argv[ i ] ) == "debug" ) {
+      debug = true;
+    } else if ( string( argv[ i ] ) == "uring" ) {
+      uring = true;
+    } else if ( string( argv[ i ] ) == "timestamping" ) {
+      timestamping = true;
+    } else if ( string( argv[ i ] ) == "compact" ) {
+      compact = true;
+    } else {
+      argc = 0; /* print usage */
+    }
+  }
+
+  /* pick one event loop (and the io_uring loop doesn't read the error queue);
+     many flows share the default one */
+  if ( (uring and timestamping) or flows < 1 or flows > MAX_FLOWS or (flows > 1 and uring) ) {
+    argc = 0;
+  }
+
+  if ( argc < 3 ) {
+    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [controller=SPEC] [flows=N] [debug] [uring | timestamping] [compact]" << endl;
+    cerr << "Controllers (SPEC is NAME[:KEY=VALUE,...]; defaults shown):" << endl << Controller::usage();
     return EXIT_FAILURE;
   }
 
+  /* all the interesting work is done by the Controllers (one per flow) */
+  vector<unique_ptr<Controller>> controllers;
+  try {
+    controllers = Controller::make_flows( controller_spec, debug, flows );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    cerr << "Controllers (SPEC is NAME[:KEY=VALUE,...]; defaults shown):" << endl << Controller::usage();
+    return EXIT_FAILURE;
+  }
+
+  /* many flows: a sender object (and socket) for each, on one event loop */
+  if ( flows > 1 ) {
+    vector<unique_ptr<DatagrumpSender>> senders;
+    Poller poller( flows >= EPOLL_MIN_FLOWS ? Poller::Backend::Epoll : Poller::Backend::Poll );
+
+    /* look the receiver up once, for every flow, with the lookup
+       itself on the Resolver's thread rather than the event loop's */
+    Resolver resolver;
+    resolver.add_action( poller );
+
+    unique_ptr<Address> receiver;
+    resolver.resolve( argv[ 1 ], argv[ 2 ],
+		      [&] ( const Address & address ) { receiver.reset( new Address( address ) ); } );
+
+    while ( not receiver ) {
+      /* (a failed lookup leaves nothing to wait for) */
+      if ( poller.poll( -1 ).result == PollResult::Exit ) {
+	return EXIT_FAILURE;
+      }
+    }
+
+    for ( auto & controller : controllers ) {
+      senders.emplace_back( new DatagrumpSender( *receiver, move( controller ), timestamping, compact ) );
+      senders.back()->add_actions( poller );
+    }
+
+    return run( poller );
+  }
+
   /* create sender object to handle the accounting */
-  /* all the interesting work is done by the Controller */
-  DatagrumpSender sender( argv[ 1 ], argv[ 2 ], debug );
+  DatagrumpSender sender( Address( argv[ 1 ], argv[ 2 ] ), move( controllers.front() ),
+			  timestamping, compact );
+  if ( uring ) {
+    return sender.loop_uring();
+  }
+
   return sender.loop();
 }
 
-DatagrumpSender::DatagrumpSender( const char * const host,
-				  const char * const port,
-				  const bool debug )
+DatagrumpSender::DatagrumpSender( const Address & receiver,
+				  unique_ptr<Controller> && controller,
+				  const bool timestamping,
+				  const bool compact )
   : socket_(),
-    controller_( debug ),
+    ack_buffer_( RECV_BATCH_SIZE ),
+    controller_( move( controller ) ),
     sequence_number_( 0 ),
-    next_ack_expected_( 0 )
+    next_ack_expected_( 0 ),
+    idle_since_( 0 ),
+    packets_(),
+    compact_( compact ),
+    last_ack_recv_timestamp_( -1 ),
+    timestamping_( timestamping ),
+    unstamped_(),
+    idle_timer_(),
+    send_action_( 0 )
 {
-  /* turn on timestamps when socket receives a datagram */
-  socket_.set_timestamps();
+  /* turn on timestamps when socket receives a datagram
+     (and, with SO_TIMESTAMPING, when each one leaves) */
+  if ( timestamping_ ) {
+    socket_.set_timestamping();
+  } else {
+    socket_.set_timestamps();
+  }
+
+  /* hand each window burst to the kernel as one buffer, if it can split it */
+  try {
+    socket_.set_gso();
+  } catch ( const unix_error & e ) {
+    cerr << "Not using UDP GSO: " << e.what() << endl;
+  }
 
   /* connect socket to the remote host */
   /* (note: this doesn't send anything; it just tags the socket
      locally with the remote address */
-  socket_.connect( Address( host, port ) );  
+  socket_.connect( receiver );
 
   cerr << "Sending to " << socket_.peer_address().to_string() << endl;
 }
 
 void DatagrumpSender::got_ack( const uint64_t timestamp,
-			       const ContestMessage & ack )
+			       const ContestMessage::View & ack )
 {
   if ( not ack.is_ack() ) {
     throw runtime_error( "sender got something other than an ack from the receiver" );
   }
 
+  /* a compact ack only holds the low bits of these, so
+     expand them against what the sender knows */
+  const uint64_t sequence_number_acked
+    = ack.expand( ack.ack_sequence_number(), sequence_number_ );
+  const uint64_t send_timestamp_acked
+    = ack.expand( ack.ack_send_timestamp(), timestamp );
+  /* (the receiver's clock has its own origin, so the low bits of its
+     first reported time serve as well as any; each later one unwraps from there) */
+  const uint64_t recv_reference = last_ack_recv_timestamp_ == uint64_t( -1 )
+    ? uint32_t( ack.ack_recv_timestamp() ) : last_ack_recv_timestamp_;
+  last_ack_recv_timestamp_
+    = ack.expand( ack.ack_recv_timestamp(), recv_reference );
+
+  idle_since_ = timestamp;
+
   /* Update sender's counter */
   next_ack_expected_ = max( next_ack_expected_,
-			    ack.header.ack_sequence_number + 1 );
+			    sequence_number_acked + 1 );
 
   /* Inform congestion controller */
-  controller_.ack_received( ack.header.ack_sequence_number,
-			    ack.header.ack_send_timestamp,
-			    ack.header.ack_recv_timestamp,
+  controller_->ack_received( sequence_number_acked,
+			    send_timestamp_acked,
+			    last_ack_recv_timestamp_,
 			    timestamp );
 }
 
+/* write the headers of count datagrams into the front of packets_ */
+void DatagrumpSender::write_packets( const uint64_t first_sequence_number,
+				     const size_t count,
+				     const uint64_t send_timestamp )
+{
+  ContestMessage::Header header( first_sequence_number );
+  header.compact = compact_;
+
+  while ( packets_.size() < count ) {
+    packets_.emplace_back( header.wire_size() + PAYLOAD_SIZE, 'x' );
+  }
+
+  for ( size_t i = 0; i < count; i++ ) {
+    header.sequence_number = first_sequence_number + i;
+    header.send_timestamp = send_timestamp;
+    header.write( &packets_[ i ][ 0 ] );
+  }
+}
+
 void DatagrumpSender::send_datagram( const bool after_timeout )
 {
-  /* All messages use the same dummy payload */
-  static const string dummy_payload( 1424, 'x' );
+  const uint64_t sequence_number = sequence_number_++;
+  const uint64_t send_timestamp = timestamp_us();
+  write_packets( sequence_number, 1, send_timestamp );
 
-  ContestMessage cm( sequence_number_++, dummy_payload );
-  cm.set_send_timestamp();
-  socket_.send( cm.to_string() );
+  const uint32_t tx_id = socket_.next_tx_id();
+  socket_.send( packets_[ 0 ] );
 
-  /* Inform congestion controller */
-  controller_.datagram_was_sent( cm.header.sequence_number,
-				 cm.header.send_timestamp,
-				 after_timeout );
+  datagram_was_sent( tx_id, sequence_number, send_timestamp, after_timeout );
+}
+
+/* fill the window, handing the whole burst (the first count of packets_)
+   to transmit at once; transmit returns the tx_timestamp id of each
+   datagram, if it knows them */
+void DatagrumpSender::send_burst( const function<vector<uint32_t>( const size_t )> & transmit )
+{
+  const uint64_t first_sequence_number = sequence_number_;
+  while ( window_is_open() ) {
+    sequence_number_++;
+  }
+  const size_t count = sequence_number_ - first_sequence_number;
+
+  /* timestamp the burst just before it goes out */
+  const uint64_t send_timestamp = timestamp_us();
+  write_packets( first_sequence_number, count, send_timestamp );
+
+  const vector<uint32_t> tx_ids = transmit( count );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    datagram_was_sent( timestamping_ ? tx_ids.at( i ) : 0,
+		       first_sequence_number + i, send_timestamp, false );
+  }
+}
+
+/* Inform congestion controller (now, or once the transmit timestamp arrives) */
+void DatagrumpSender::datagram_was_sent( const uint32_t tx_id,
+					 const uint64_t sequence_number,
+					 const uint64_t send_timestamp,
+					 const bool after_timeout )
+{
+  if ( timestamping_ ) {
+    unstamped_.push_back( { tx_id, sequence_number, after_timeout } );
+    return;
+  }
+
+  controller_->datagram_was_sent( sequence_number, send_timestamp, after_timeout );
+}
+
+/* tell the controller when the datagrams on the error queue really left */
+void DatagrumpSender::got_tx_timestamps()
+{
+  for ( const auto & stamp : socket_.recv_tx_timestamps() ) {
+    /* ids are assigned in order (and wrap), and a GSO buffer's datagrams share one */
+    while ( not unstamped_.empty()
+	    and int32_t( unstamped_.front().tx_id - stamp.id ) <= 0 ) {
+      const unstamped_datagram & sent = unstamped_.front();
+      controller_->datagram_was_sent( sent.sequence_number,
+				     stamp.timestamp_ns / 1000,
+				     sent.after_timeout );
+      unstamped_.pop_front();
+    }
+  }
+}
+
+/* process a batch of acks */
+void DatagrumpSender::got_acks( const UDPSocket::ReceiveBuffer & acks )
+{
+  for ( const auto & recd : acks ) {
+    got_ack( recd.timestamp_ns / 1000, ContestMessage::View( recd.payload, recd.payload_length ) );
+  }
+}
+
+/* if no ack has arrived for the controller's timeout, send one datagram
+   to try to get things moving again (acks don't re-arm the timer; it
+   checks how long things have been idle when it fires) */
+void DatagrumpSender::idle_timer_expired()
+{
+  const uint64_t now = timestamp_us();
+  const uint64_t deadline = idle_since_ + controller_->timeout_ms() * uint64_t( 1000 );
+
+  if ( now < deadline ) {
+    idle_timer_.arm( (deadline - now) * 1000 );
+  } else {
+    send_datagram( true );
+    idle_since_ = now;
+    idle_timer_.arm( controller_->timeout_ms() * uint64_t( 1000000 ) );
+  }
 }
 
 bool DatagrumpSender::window_is_open()
 {
-  return sequence_number_ - next_ack_expected_ < controller_.window_size();
+  return sequence_number_ - next_ack_expected_ < controller_->window_size();
 }
 
 int DatagrumpSender::loop()
 {
-  /* read and write from the receiver using an event-driven "poller" */
+  /* read and write from the receiver using an event-driven "poller"
+     (with a single socket, poll() is as cheap as epoll or cheaper) */
   Poller poller;
+  add_actions( poller );
+
+  return run( poller );
+}
 
+void DatagrumpSender::add_actions( Poller & poller )
+{
   /* first rule: if the window is open, close it by
-     sending more datagrams */
-  poller.add_action( Action( socket_, Direction::Out, [&] () {
+     sending more datagrams (the window only moves in these
+     callbacks, so each one tells the poller whether it's open) */
+  send_action_ = poller.add_action( Action( socket_, Direction::Out, [this, &poller] () {
 	/* Close the window */
-	while ( window_is_open() ) {
-	  send_datagram( false );
-	}
+	send_burst( [&] ( const size_t count ) { return socket_.send_batch( packets_.data(), count ); } );
+	update_send_interest( poller );
 	return ResultType::Continue;
-      },
-      /* We're only interested in this rule when the window is open */
-      [&] () { return window_is_open(); } ) );
+      } ) );
+  update_send_interest( poller );
 
-  /* second rule: if sender receives an ack,
-     process it and inform the controller
+  /* second rule: if sender receives acks,
+     process them and inform the controller
      (by using the sender's got_ack method) */
-  poller.add_action( Action( socket_, Direction::In, [&] () {
-	const UDPSocket::received_datagram recd = socket_.recv();
-	const ContestMessage ack  = recd.payload;
-	got_ack( recd.timestamp, ack );
+  poller.add_action( Action( socket_, Direction::In, [this, &poller] () {
+	socket_.recv_batch( ack_buffer_ );
+	got_acks( ack_buffer_ );
+	update_send_interest( poller );
 	return ResultType::Continue;
       } ) );
 
-  /* Run these two rules forever */
+  /* third rule: if the kernel has reported when datagrams left,
+     pass the times on to the controller */
+  const size_t tx_timestamps = poller.add_action( Action( socket_, Direction::Error, [this, &poller] () {
+	got_tx_timestamps();
+	update_send_interest( poller );
+	return ResultType::Continue;
+      } ) );
+  poller.set_interest( tx_timestamps, timestamping_ );
+
+  /* fourth rule: if no ack has arrived for a while, try to get things moving again */
+  idle_timer_.arm( controller_->timeout_ms() * uint64_t( 1000000 ) );
+  poller.add_timer_action( idle_timer_, [this, &poller] () {
+      idle_timer_expired();
+      update_send_interest( poller );
+      return ResultType::Continue;
+    } );
+}
+
+/* We're only interested in the first rule when the window is open */
+void DatagrumpSender::update_send_interest( Poller & poller )
+{
+  poller.set_interest( send_action_, window_is_open() );
+}
+
+int DatagrumpSender::loop_uring()
+{
+  /* same rules as loop(), but on an io_uring that keeps a receive armed
+     and takes sends without waiting for the socket to be writable */
+  URingEngine engine;
+
+  /* if sender receives an ack, process it and inform the controller */
+  engine.add_receive_action( socket_, [&] ( const UDPSocket::datagram_view & recd ) {
+      got_ack( recd.timestamp_ns / 1000, ContestMessage::View( recd.payload, recd.payload_length ) );
+      return ResultType::Continue;
+    } );
+
   while ( true ) {
-    const auto ret = poller.poll( controller_.timeout_ms() );
+    /* if the window is open, close it by queueing more datagrams */
+    if ( window_is_open() ) {
+      send_burst( [&] ( const size_t count ) {
+	  for ( size_t i = 0; i < count; i++ ) {
+	    engine.send( socket_, packets_[ i ].data(), packets_[ i ].size() );
+	  }
+	  return vector<uint32_t>();
+	} );
+    }
+
+    const auto ret = engine.wait( controller_->timeout_ms() );
     if ( ret.result == PollResult::Exit ) {
       return ret.exit_status;
     } else if ( ret.result == PollResult::Timeout ) {
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "transition_kernel.hh"
+
+using namespace std;
+
+TransitionKernel::TransitionKernel( const int buckets, const double width,
+				    const Method method, const double tolerance )
+  : buckets_( buckets ),
+    width_( width ),
+    tail_( 0 ),
+    stddev_( 0 ),
+    band_( 0 ),
+    weights_(),
+    method_( method ),
+    fft_(),
+    real_(),
+    imaginary_()
+{
+  if ( buckets < 2 ) {
+    throw runtime_error( "TransitionKernel needs at least two buckets" );
+  }
+
+  while ( erfc( tail_ ) >= tolerance ) {
+    tail_ += 0.01;
+  }
+}
+
+/* recompute the weights if stddev has changed */
+void TransitionKernel::set_stddev( const double stddev )
+{
+  if ( stddev == stddev_ ) {
+    return;
+  }
+  stddev_ = stddev;
+
+  /* both tails beyond the band (|d| > band) hold less than
+     erfc( ( band + 1 - width ) / stddev ) of the probability */
+  band_ = min<double>( buckets_ - 1, max( 0.0, ceil( tail_ * stddev - 1 + width_ ) ) );
+
+  const auto cdf = [stddev] ( const double x ) { return 0.5 * erfc( -x / stddev ); };
+
+  weights_.resize( 2 * band_ + 1 );
+  for ( int d = -band_; d <= band_; d++ ) {
+    weights_[ band_ + d ] = cdf( d + width_ ) - cdf( d );
+  }
+}
+
+/* dst[ i ] += a * src[ i ], in fixed-size blocks the compiler turns
+   into vector instructions (the pointers never overlap) */
+template <int BLOCK>
+static void axpy( double * __restrict__ dst, const double * __restrict__ src,
+		  const double a, const int length )
+{
+  int i = 0;
+  for ( ; i + BLOCK <= length; i += BLOCK ) {
+    for ( int j = 0; j < BLOCK; j++ ) {
+      dst[ i + j ] += a * src[ i + j ];
+    }
+  }
+
+  for ( ; i < length; i++ ) {
+    dst[ i ] += a * src[ i ];
+  }
+}
+
+/* how apply() will convolve, at the current stddev */
+TransitionKernel::Method TransitionKernel::method() const
+{
+  if ( method_ != Method::Automatic ) {
+    return method_;
+  }
+
+  /* multiply-adds for the banded method, against roughly what two
+     transforms of about buckets + band points cost (measured with
+     benchmarks/rate_model_benchmark) */
+  const double banded_cost = double( buckets_ - 1 ) * (2 * band_ + 1);
+  const double points = buckets_ + band_;
+  const double fourier_cost = FOURIER_COST_FACTOR * points * log2( points );
+
+  return banded_cost > fourier_cost ? Method::Fourier : Method::Banded;
+}
+
+/* out[ n ] = sum over o of in[ o ] * weight( n - o ), for buckets 1 and up */
+void TransitionKernel::apply( const double * in, double * out )
+{
+  if ( method() == Method::Fourier ) {
+    apply_fourier( in, out );
+  } else {
+    apply_banded( in, out );
+  }
+}
+
+/* the convolution as direct multiply-adds over the band */
+void TransitionKernel::apply_banded( const double * in, double * out ) const
+{
+  const int last = buckets_ - 1;
+  fill( out + 1, out + buckets_, 0.0 );
+
+  /* spread each old bucket's probability over its band of new buckets
+     (each out[ n ] still sums its terms in order of o, as the dense loop did) */
+  for ( int o = 1; o <= last; o++ ) {
+    const int first = max( 1, o - band_ );
+    const int end = min( last, o + band_ ) + 1;
+    axpy<BLOCK>( out + first, &weights_[ band_ + first - o ], in[ o ], end - first );
+  }
+}
+
+/* the convolution by FFT: transform, multiply, transform back */
+void TransitionKernel::apply_fourier( const double * in, double * out )
+{
+  /* The circular convolution of the input (buckets 1 to buckets - 1) and
+     the weights (offsets -band to band, stored from index 0) matches the
+     linear one at the indices we read back as long as the transform
+     has at least buckets + band - 1 points (and room for the weights) */
+  size_t size = 2;
+  while ( size < size_t( max( buckets_ + band_ - 1, 2 * band_ + 1 ) ) ) {
+    size *= 2;
+  }
+
+  if ( not fft_ or fft_->size() != size ) {
+    fft_.reset( new FFT( size ) );
+    real_.resize( size );
+    imaginary_.resize( size );
+  }
+
+  /* both inputs are real, so transform them together, one as the real
+     part and one as the imaginary part */
+  fill( real_.begin(), real_.end(), 0.0 );
+  fill( imaginary_.begin(), imaginary_.end(), 0.0 );
+  copy( in + 1, in + buckets_, real_.begin() + 1 );
+  copy( weights_.begin(), weights_.end(), imaginary_.begin() );
+
+  fft_->forward( real_.data(), imaginary_.data() );
+
+  /* separate the two spectra, X = (A[ f ] + conj( A[ -f ] )) / 2 and
+     Y = (A[ f ] - conj( A[ -f ] )) / 2i, and multiply them; the product
+     of real signals' spectra at -f is the conjugate of that at f */
+  for ( size_t f = 0; f <= size / 2; f++ ) {
+    const size_t g = (size - f) & (size - 1);
+
+    const double x_real = (real_[ f ] + real_[ g ]) / 2;
+    const double x_imaginary = (imaginary_[ f ] - imaginary_[ g ]) / 2;
+    const double y_real = (imaginary_[ f ] + imaginary_[ g ]) / 2;
+    const double y_imaginary = -(real_[ f ] - real_[ g ]) / 2;
+
+    const double product_real = x_real * y_real - x_imaginary * y_imaginary;
+    const double product_imaginary = x_real * y_imaginary + x_imaginary * y_real;
+
+    real_[ f ] = product_real;
+    imaginary_[ f ] = product_imaginary;
+    real_[ g ] = product_real;
+    imaginary_[ g ] = -product_imaginary;
+  }
+
+  fft_->inverse( real_.data(), imaginary_.data() );
+
+  /* weight index band_ is offset zero, so new bucket n sits at n + band_ */
+  for ( int n = 1; n < buckets_; n++ ) {
+    out[ n ] = max( 0.0, real_[ n + band_ ] );
+  }
+}
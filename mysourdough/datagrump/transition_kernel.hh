@@ -0,0 +1,81 @@
+#ifndef TRANSITION_KERNEL_HH
+#define TRANSITION_KERNEL_HH
+
+#include <memory>
+#include <vector>
+
+#include "fft.hh"
+
+/* The controller's rate-evolution step as a convolution.
+
+   Each tick, probability moves from rate bucket o to bucket n with
+   weight cdf( n - o + width ) - cdf( n - o ), for a zero-mean Gaussian
+   cdf of the given stddev. That only depends on n - o, so instead of
+   two erfc() calls for every (o, n) pair, the weights for every offset
+   are computed once per stddev, and the step is a 1-D convolution.
+
+   Offsets whose weight can't matter are dropped: the band covers every
+   |n - o| up to where the Gaussian's two tails hold less than
+   tolerance, so the result differs from the dense sum by less than
+   tolerance times the total probability (in the L1 norm).
+
+   The convolution itself is either banded (direct multiply-adds, about
+   buckets * band of them) or done with FFTs (O( buckets log buckets ),
+   whatever the band), which is what makes grids of thousands of buckets
+   affordable once the stddev spreads the band over most of the grid.
+   The FFT route adds round-off of about 1e-16 times log2( buckets ) per
+   bucket (relative to the total probability); slightly negative results
+   are clamped to zero. By default apply() picks whichever is cheaper. */
+class TransitionKernel
+{
+public:
+  enum class Method { Banded, Fourier, Automatic };
+
+private:
+  /* doubles processed per step of the convolution's inner loop */
+  static const int BLOCK = 4;
+
+  /* cost of a Fourier convolution of n points, in banded multiply-adds
+     per n log2( n ) (see method()) */
+  static constexpr double FOURIER_COST_FACTOR = 24;
+
+  int buckets_;
+  double width_;
+
+  /* erfc( tail_ ) is below the tolerance */
+  double tail_;
+
+  double stddev_; /* of the current weights (zero before the first) */
+  int band_; /* largest |n - o| with a nonzero weight */
+
+  /* weights_[ band_ + d ] for d = n - o */
+  std::vector<double> weights_;
+
+  Method method_;
+
+  /* for the Fourier method: a transform long enough for the current
+     band, and its input and output */
+  std::unique_ptr<FFT> fft_;
+  std::vector<double> real_, imaginary_;
+
+  void apply_banded( const double * in, double * out ) const;
+  void apply_fourier( const double * in, double * out );
+
+public:
+  TransitionKernel( const int buckets, const double width,
+		    const Method method = Method::Automatic, const double tolerance = 1e-12 );
+
+  /* recompute the weights if stddev has changed */
+  void set_stddev( const double stddev );
+
+  int band() const { return band_; }
+
+  /* how apply() will convolve, at the current stddev (Banded or Fourier) */
+  Method method() const;
+
+  /* out[ n ] = sum over o of in[ o ] * weight( n - o ), for buckets 1
+     and up (bucket 0 neither gives nor receives; out[ 0 ] is untouched) */
+  void apply( const double * in, double * out );
+};
+
+#endif /* TRANSITION_KERNEL_HH */
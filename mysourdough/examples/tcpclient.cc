@@ -35,14 +35,23 @@ int main( int argc, char *argv[] )
   socket.connect( server );
   cerr << "done." << endl;
 
+  /* from here on, a slow server shouldn't hold up reading the keyboard */
+  socket.set_blocking( false );
+
   /* now read and write from the server using an event-driven "poller" */
   Poller poller;
 
   /* first rule: if the socket has data ready (in the "In" direction),
-     print it to the screen (cout) */
+     print it to the screen (cout) (read_into() finds nothing, rather
+     than throwing, if the nonblocking socket woke us up for nothing) */
+  RingBuffer received( 65536 );
   poller.add_action( Action( socket, Direction::In,
 			     [&] () {
-			       cout << socket.read();
+			       const buffer_view chunk = socket.read_into( received );
+			       cout.write( chunk.first, chunk.first_length );
+			       cout.write( chunk.second, chunk.second_length );
+			       cout.flush();
+			       received.consume( chunk.size() );
 
 			       /* exit if the server closes the connection */
 			       if ( socket.eof() ) {
@@ -53,15 +62,27 @@ int main( int argc, char *argv[] )
 			     } ) );
 
   /* second rule: if the keyboard has data ready (also in the "In" direction),
-     write it to the server, plus a carriage return and newline */
+     queue it for the server, plus a carriage return and newline */
   FileDescriptor keyboard( 0 );
+  const string line_ending = "\r\n";
   poller.add_action( Action( keyboard, Direction::In,
 			     [&] () {
-			       socket.write( keyboard.read() + "\r\n" );
+			       socket.queue_write( keyboard.read() );
+			       socket.queue_write( line_ending );
 			       return ResultType::Continue;
 			     } ) );
 
-  /* run these two rules forever until it's time to quit */
+  /* third rule: if anything is queued for the server and the socket
+     can take more (the "Out" direction), send it (both pieces of each
+     line, and any earlier lines still waiting, go in one syscall) */
+  poller.add_action( Action( socket, Direction::Out,
+			     [&] () {
+			       socket.flush();
+			       return ResultType::Continue;
+			     },
+			     [&] () { return socket.queued_bytes() > 0; } ) );
+
+  /* run these rules forever until it's time to quit */
   while ( true ) {
     const auto ret = poller.poll( -1 );
     if ( ret.result == PollResult::Exit ) {
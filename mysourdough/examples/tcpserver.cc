@@ -4,11 +4,14 @@
 #include <thread>
 #include <iostream>
 
-#include "socket.hh"
+#include "tcp_server.hh"
 #include "util.hh"
 
 using namespace std;
 
+/* most worker threads (each has a listening socket and an event loop) */
+static const unsigned int MAX_THREADS = 1024;
+
 int main( int argc, char *argv[] )
 {
   /* check the command-line arguments */
@@ -16,54 +19,44 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  /* one worker per core unless told otherwise */
+  unsigned int threads = max( 1u, thread::hardware_concurrency() );
+
+  if ( (argc != 2 and argc != 3)
+       or (argc == 3 and (not parse_unsigned( argv[ 2 ], threads )
+			  or threads < 1 or threads > MAX_THREADS)) ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT [THREADS]" << endl;
     return EXIT_FAILURE;
   }
 
-  /* create a TCP socket */
-  TCPSocket listening_socket;
-
-  /* it's ok to reuse the server's address as soon as the program quits
-     (this helps debugging, at the slight cost to robustness) */
-  listening_socket.set_reuseaddr();
-
-  /* "bind" the socket to the user-specified local port number */
-  listening_socket.bind( Address( "::0", argv[ 1 ] ) );
-
-  /* mark the socket as listening for incoming connections */
-  listening_socket.listen();
-  cerr << "Listening on local address: " << listening_socket.local_address().to_string() << endl;
-
-  /* Wait for clients to connect */
-  while ( true ) {
-
-    /* This line does a lot. It waits for a client to connect
-       ("listening_socket.accept()"). When that returns a new socket,
-       it starts a thread to handle that client and passes in the
-       result of accept() as the "client" parameter to the handler. */
-
-    thread client_handler( [] ( TCPSocket client ) {
-	cerr << "New connection from " << client.peer_address().to_string() << endl;
-
-	/* Print every line that the client sends */
-	while ( true ) {
-	  const string chunk = client.read();
-	  if ( client.eof() ) { break; }
-	  cerr << "Got " << chunk.size() << " bytes from "
-	       << client.peer_address().to_string() << ": " << chunk;
-	  client.write( "Received " + to_string( chunk.size() ) + " bytes from you.\n" );
-	}
-
-	cerr << client.peer_address().to_string() << " closed the connection." << endl; 
-      }, listening_socket.accept() );
-
-    /* Let the client handler continue to run without having
-       to keep track of it. The main thread can go back to accepting
-       new incoming connections. */
-
-    client_handler.detach();
-  }
+  /* Listen on the user-specified local port number. Each worker
+     thread has its own listening socket and serves the connections it
+     accepts from its own event loop, so a client costs a socket and a
+     buffer instead of a thread. */
+  TCPServer server( Address( "::0", argv[ 1 ] ), threads,
+
+		    /* Print every chunk that a client sends */
+		    [] ( TCPServer::Connection & client ) {
+		      const buffer_view chunk = client.input().readable();
+		      cerr << "Got " << chunk.size() << " bytes from " << client.peer() << ": ";
+		      cerr.write( chunk.first, chunk.first_length );
+		      cerr.write( chunk.second, chunk.second_length );
+		      client.socket().queue_write( "Received " + to_string( chunk.size() ) + " bytes from you.\n" );
+		      client.input().consume( chunk.size() );
+		    },
+
+		    [] ( TCPServer::Connection & client ) {
+		      cerr << "New connection from " << client.peer() << endl;
+		    },
+
+		    [] ( TCPServer::Connection & client ) {
+		      cerr << client.peer() << " closed the connection." << endl;
+		    } );
+
+  cerr << "Listening on local address: " << server.local_address().to_string()
+       << " with " << threads << " worker thread" << (threads == 1 ? "" : "s") << endl;
+
+  server.run();
 
   return EXIT_SUCCESS;
 }
@@ -2,6 +2,7 @@
 #include <cstring>
 #include <memory>
 
+#include <arpa/inet.h>
 #include <netdb.h>
 
 #include "address.hh"
@@ -99,29 +100,39 @@ Address::Address( const std::string & ip, const uint16_t port )
 
 pair<string, uint16_t> Address::ip_port() const
 {
-  char ip[ NI_MAXHOST ], port[ NI_MAXSERV ];
+  char ip[ INET6_ADDRSTRLEN ];
+
+  /* format plain IPv4 and IPv6 addresses ourselves, showing v4-mapped ones as IPv4 */
+  if ( addr_.as_sockaddr.sa_family == AF_INET6
+       and size_ >= sizeof( sockaddr_in6 )
+       and addr_.as_sockaddr_in6.sin6_scope_id == 0 ) {
+    const in6_addr & address = addr_.as_sockaddr_in6.sin6_addr;
+    const bool mapped = IN6_IS_ADDR_V4MAPPED( &address );
+    if ( inet_ntop( mapped ? AF_INET : AF_INET6,
+		    mapped ? static_cast<const void *>( &address.s6_addr[ 12 ] ) : &address,
+		    ip, sizeof( ip ) ) ) {
+      return make_pair( string( ip ), ntohs( addr_.as_sockaddr_in6.sin6_port ) );
+    }
+  } else if ( addr_.as_sockaddr.sa_family == AF_INET
+	      and size_ >= sizeof( sockaddr_in ) ) {
+    if ( inet_ntop( AF_INET, &addr_.as_sockaddr_in.sin_addr, ip, sizeof( ip ) ) ) {
+      return make_pair( string( ip ), ntohs( addr_.as_sockaddr_in.sin_port ) );
+    }
+  }
+
+  /* anything else (e.g. a scoped link-local address) */
+  char host[ NI_MAXHOST ], port[ NI_MAXSERV ];
 
   const int gni_ret = getnameinfo( &to_sockaddr(),
                                    size_,
-                                   ip, sizeof( ip ),
+                                   host, sizeof( host ),
                                    port, sizeof( port ),
                                    NI_NUMERICHOST | NI_NUMERICSERV );
   if ( gni_ret ) {
     throw tagged_error( gai_error_category(), "getnameinfo", gni_ret );
   }
 
-  /* attempt to shorten v4-mapped address if possible */
-  string ip_string { ip };
-  if ( ip_string.size() > 7
-       and ip_string.substr( 0, 7 ) == "::ffff:" ) {
-    const string candidate_ipv4 = ip_string.substr( 7 );
-    Address candidate_addr( candidate_ipv4, stoi( port ) );
-    if ( candidate_addr == *this ) {
-      ip_string = candidate_ipv4;
-    }
-  }
-
-  return make_pair( ip_string, stoi( port ) );
+  return make_pair( string( host ), stoi( port ) );
 }
 
 string Address::to_string() const
@@ -138,5 +149,35 @@ const sockaddr & Address::to_sockaddr() const
 /* equality */
 bool Address::operator==( const Address & other ) const
 {
-  return 0 == memcmp( &addr_, &other.addr_, size_ );
+  return size_ == other.size_ and 0 == memcmp( &addr_, &other.addr_, size_ );
+}
+
+/* hash of the ip and port (FNV-1a) */
+size_t Address::hash() const
+{
+  const char * bytes = reinterpret_cast<const char *>( &addr_ );
+  size_t length = size_;
+
+  /* skip what doesn't tell flows apart (equal addresses still hash equally) */
+  if ( addr_.as_sockaddr.sa_family == AF_INET6 and size_ >= sizeof( sockaddr_in6 ) ) {
+    bytes = reinterpret_cast<const char *>( &addr_.as_sockaddr_in6.sin6_addr );
+    length = sizeof( in6_addr );
+  } else if ( addr_.as_sockaddr.sa_family == AF_INET and size_ >= sizeof( sockaddr_in ) ) {
+    bytes = reinterpret_cast<const char *>( &addr_.as_sockaddr_in.sin_addr );
+    length = sizeof( in_addr );
+  }
+
+  uint64_t hash = 14695981039346656037ULL;
+  const auto mix = [&hash] ( const char * data, const size_t count ) {
+    for ( size_t i = 0; i < count; i++ ) {
+      hash = (hash ^ uint8_t( data[ i ] )) * 1099511628211ULL;
+    }
+  };
+
+  mix( bytes, length );
+
+  /* the port sits at the same offset in both sockaddr_in and sockaddr_in6 */
+  mix( reinterpret_cast<const char *>( &addr_.as_sockaddr_in.sin_port ), sizeof( in_port_t ) );
+
+  return hash;
 }
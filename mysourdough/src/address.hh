@@ -1,6 +1,7 @@
 #ifndef ADDRESS_HH
 #define ADDRESS_HH
 
+#include <functional>
 #include <string>
 #include <utility>
 
@@ -13,6 +14,8 @@ class Address
 public:
   typedef union {
     sockaddr as_sockaddr;
+    sockaddr_in as_sockaddr_in;
+    sockaddr_in6 as_sockaddr_in6;
     sockaddr_storage as_sockaddr_storage;
   } raw;
 
@@ -40,13 +43,27 @@ public:
   std::pair<std::string, uint16_t> ip_port() const;
   std::string ip() const { return ip_port().first; }
   uint16_t port() const { return ip_port().second; }
+
+  /* "ip:port" (formatted without a name lookup, but on every call: to
+     log an address often, keep the string, e.g. TCPServer::Connection::peer()) */
   std::string to_string() const;
 
   socklen_t size() const { return size_; }
   const sockaddr & to_sockaddr() const;
 
-  /* equality */
+  /* equality (of the raw bytes, so cheap enough for hot flow tables) */
   bool operator==( const Address & other ) const;
+  bool operator!=( const Address & other ) const { return not operator==( other ); }
+
+  /* hash of the ip and port, for unordered containers */
+  size_t hash() const;
 };
 
+namespace std {
+  template <> struct hash<Address>
+  {
+    size_t operator()( const Address & address ) const { return address.hash(); }
+  };
+}
+
 #endif /* ADDRESS_HH */
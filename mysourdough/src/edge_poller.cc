@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include "edge_poller.hh"
+
+using namespace std;
+
+EdgePoller::EdgePoller()
+  : epoll_fd_( SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ),
+    watched_( 0 ),
+    ready_events_( 1 )
+{}
+
+/* watch fd for events, reporting them with token */
+void EdgePoller::add( FileDescriptor & fd, const uint32_t events, const uint32_t token )
+{
+  epoll_event event;
+  zero( event );
+  event.events = events | EPOLLET;
+  event.data.u32 = token;
+  SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd.fd_num(), &event ) );
+
+  watched_++;
+  if ( watched_ > ready_events_.size() ) {
+    ready_events_.resize( watched_ );
+  }
+}
+
+/* stop watching fd */
+void EdgePoller::remove( FileDescriptor & fd )
+{
+  SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_DEL, fd.fd_num(), nullptr ) );
+
+  watched_--;
+  if ( ready_events_.size() > max( watched_, size_t( 1 ) ) ) {
+    ready_events_.pop_back();
+  }
+}
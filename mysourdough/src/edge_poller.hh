@@ -0,0 +1,81 @@
+#ifndef EDGE_POLLER_HH
+#define EDGE_POLLER_HH
+
+#include <vector>
+
+#include <sys/epoll.h>
+
+#include "file_descriptor.hh"
+#include "poller.hh"
+#include "util.hh"
+
+/* Edge-triggered epoll loop: an alternative to Poller with less
+   bookkeeping per wakeup. Each fd is registered once (with EPOLLET)
+   and never touched again, there is no when_interested() to evaluate
+   and no busy-wait check on every iteration, and the handler is a
+   template parameter, so it is called directly rather than through a
+   std::function. (With one busy flow moving the same batch per wakeup,
+   benchmarks/poller_benchmark measures no difference from Poller: the
+   syscalls dominate.)
+
+   In exchange, the kernel only reports changes in readiness: every time
+   the handler hears an fd is readable, it must read until EAGAIN (e.g.
+   with UDPSocket::try_recv_batch()), and a writer must write until EAGAIN
+   or until it has nothing left, because it won't be told again. */
+class EdgePoller
+{
+public:
+  typedef Poller::Action::Result HandlerResult;
+
+private:
+  FileDescriptor epoll_fd_;
+
+  /* how many fds are watched, and room for one event from each (but
+     never none, so poll() with nothing to watch still just waits) */
+  size_t watched_;
+  std::vector<epoll_event> ready_events_;
+
+public:
+  EdgePoller();
+
+  /* watch fd for events (EPOLLIN, EPOLLOUT, ...); when some become
+     ready, the handler is called with token and the ready events
+     (including EPOLLERR and EPOLLHUP, which the handler must deal with) */
+  void add( FileDescriptor & fd, const uint32_t events, const uint32_t token );
+
+  /* stop watching fd (before closing it, if it might have been dup()ed) */
+  void remove( FileDescriptor & fd );
+
+  /* wait up to timeout_ms, then call handler( token, events ) for
+     each ready fd; the handler returns Continue or Exit */
+  template <typename Handler>
+  Poller::Result poll( const int timeout_ms, Handler && handler );
+};
+
+template <typename Handler>
+Poller::Result EdgePoller::poll( const int timeout_ms, Handler && handler )
+{
+  const int ready_count = epoll_wait( epoll_fd_.fd_num(), ready_events_.data(),
+				      ready_events_.size(), timeout_ms );
+
+  if ( ready_count < 0 ) {
+    if ( errno == EINTR ) {
+      return Poller::Result::Type::Exit;
+    }
+    throw unix_error( "epoll_wait" );
+  } else if ( ready_count == 0 ) {
+    return Poller::Result::Type::Timeout;
+  }
+
+  for ( int i = 0; i < ready_count; i++ ) {
+    const HandlerResult result = handler( ready_events_[ i ].data.u32, ready_events_[ i ].events );
+
+    if ( result.result == HandlerResult::Type::Exit ) {
+      return Poller::Result( Poller::Result::Type::Exit, result.exit_status );
+    }
+  }
+
+  return Poller::Result::Type::Success;
+}
+
+#endif /* EDGE_POLLER_HH */
@@ -1,6 +1,10 @@
 #include "file_descriptor.hh"
 #include "util.hh"
 
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 using namespace std;
@@ -59,16 +63,46 @@ string::const_iterator FileDescriptor::write( const string::const_iterator & beg
 /* read method */
 string FileDescriptor::read( const size_t limit )
 {
-  char buffer[ BUFFER_SIZE ];
+  /* per-thread scratch space instead of a BUFFER_SIZE array on every call's stack */
+  static thread_local unique_ptr<char[]> buffer( new char[ BUFFER_SIZE ] );
 
-  ssize_t bytes_read = SystemCall( "read", ::read( fd_, buffer, min( BUFFER_SIZE, limit ) ) );
+  ssize_t bytes_read = SystemCall( "read", ::read( fd_, buffer.get(), min( BUFFER_SIZE, limit ) ) );
   if ( bytes_read == 0 ) {
     set_eof();
   }
 
   register_read();
 
-  return string( buffer, bytes_read );
+  return string( buffer.get(), bytes_read );
+}
+
+/* read (with readv) into buffer's free space, without allocating */
+buffer_view FileDescriptor::read_into( RingBuffer & buffer )
+{
+  if ( buffer.free_space() == 0 ) {
+    throw runtime_error( "read_into: buffer is full" );
+  }
+
+  iovec regions[ 2 ];
+  const int region_count = buffer.writable( regions );
+
+  const ssize_t bytes_read = ::readv( fd_, regions, region_count );
+  if ( bytes_read < 0 ) {
+    if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+      /* nonblocking and nothing to read (after a spurious wakeup, say):
+	 still an attempt, so Poller doesn't take it for a busy wait */
+      register_read();
+      return buffer.newest( 0 );
+    }
+    throw unix_error( "readv" );
+  } else if ( bytes_read == 0 ) {
+    set_eof();
+  }
+
+  register_read();
+
+  buffer.produce( bytes_read );
+  return buffer.newest( bytes_read );
 }
 
 /* write method */
@@ -82,3 +116,38 @@ string::const_iterator FileDescriptor::write( const std::string & buffer, const
 
   return it;
 }
+
+/* move bytes straight to destination with splice() */
+size_t FileDescriptor::splice_to( FileDescriptor & destination, const size_t length )
+{
+  const ssize_t bytes_moved = ::splice( fd_, nullptr, destination.fd_, nullptr, length,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+
+  if ( bytes_moved < 0 ) {
+    /* (nothing moved, so nothing to count: a Poller that keeps
+       waking up for this still sees a busy wait) */
+    if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+      return 0;
+    }
+    throw unix_error( "splice" );
+  } else if ( bytes_moved == 0 ) {
+    if ( length > 0 ) {
+      set_eof();
+      register_read();
+    }
+    return 0;
+  }
+
+  register_read();
+  destination.register_write();
+
+  return bytes_moved;
+}
+
+/* make reads and writes wait (or not) for the fd to be ready */
+void FileDescriptor::set_blocking( const bool blocking )
+{
+  const int flags = SystemCall( "fcntl", fcntl( fd_, F_GETFL ) );
+  SystemCall( "fcntl", fcntl( fd_, F_SETFL,
+			      blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK) ) );
+}
@@ -3,6 +3,8 @@
 
 #include <string>
 
+#include "ring_buffer.hh"
+
 /* Unix file descriptors (sockets, files, etc.) */
 class FileDescriptor
 {
@@ -42,8 +44,21 @@ public:
 
   /* read and write methods */
   std::string read( const size_t limit = BUFFER_SIZE );
+
+  /* read (with readv) into buffer's free space, without allocating;
+     returns a view of the bytes just read (empty, without eof(), if the
+     fd is nonblocking and had nothing to read) */
+  buffer_view read_into( RingBuffer & buffer );
   std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
 
+  /* move up to length bytes straight to destination with splice(), without
+     copying them through user space (one of the two fds must be a pipe);
+     returns how many moved, zero if either side would block or at EOF */
+  size_t splice_to( FileDescriptor & destination, const size_t length );
+
+  /* make reads and writes wait (or not) for the fd to be ready */
+  void set_blocking( const bool blocking );
+
   /* forbid copying FileDescriptor objects or assigning them */
   FileDescriptor( const FileDescriptor & other ) = delete;
   const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
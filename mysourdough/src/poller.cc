@@ -1,6 +1,5 @@
 #include <algorithm>
 #include <cassert>
-#include <numeric>
 
 #include "poller.hh"
 #include "util.hh"
@@ -8,42 +7,185 @@
 using namespace std;
 using namespace PollerShortNames;
 
-void Poller::add_action( Poller::Action action )
+Poller::Poller( const Backend & backend )
+  : backend_( backend ),
+    actions_(),
+    pollfds_(),
+    evaluated_(),
+    interested_count_( 0 ),
+    epoll_fd_( backend == Backend::Epoll
+	       ? SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) )
+	       : -1 ),
+    registrations_(),
+    registration_of_(),
+    dirty_registrations_(),
+    ready_events_()
+{}
+
+size_t Poller::add_action( Poller::Action action )
 {
+  const size_t index = actions_.size();
   actions_.push_back( action );
   pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+
+  if ( action.when_interested ) {
+    evaluated_.push_back( index );
+  }
+
+  if ( backend_ == Backend::Epoll ) {
+    /* register each fd with the kernel once, with no interest yet */
+    const auto existing = find_if( registrations_.begin(), registrations_.end(),
+				   [&] ( const EpollRegistration & x ) { return x.fd == action.fd.fd_num(); } );
+    if ( existing != registrations_.end() ) {
+      existing->action_indices.push_back( index );
+      registration_of_.push_back( existing - registrations_.begin() );
+    } else {
+      epoll_event event;
+      zero( event );
+      event.data.u32 = registrations_.size();
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD,
+					  action.fd.fd_num(), &event ) );
+
+      registration_of_.push_back( registrations_.size() );
+      registrations_.push_back( { action.fd.fd_num(), 0, { index }, false } );
+      ready_events_.resize( registrations_.size() );
+    }
+  }
+
+  refresh( index );
+  return index;
+}
+
+/* start or stop polling for an action without a when_interested() */
+void Poller::set_interest( const size_t index, const bool interested )
+{
+  actions_.at( index ).interested = interested;
+  refresh( index );
+}
+
+/* run callback each time timer expires */
+void Poller::add_timer_action( Timer & timer, const Action::CallbackType & callback )
+{
+  add_action( Action( timer, Direction::In, [&timer, callback] () -> Action::Result {
+	/* nothing to do if the timer was re-armed or disarmed after it became readable */
+	if ( timer.read_expirations() == 0 ) {
+	  return ResultType::Continue;
+	}
+
+	return callback();
+      } ) );
 }
 
 unsigned int Poller::Action::service_count() const
 {
-  return direction == Direction::In ? fd.read_count() : fd.write_count();
+  return direction == Direction::Out ? fd.write_count() : fd.read_count();
 }
 
-Poller::Result Poller::poll( const int & timeout_ms )
+/* should the fd be polled for this action now? */
+bool Poller::Action::wants_fd() const
 {
-  assert( pollfds_.size() == actions_.size() );
+  /* (don't poll in on fds that have had EOF) */
+  return active
+    and (when_interested ? when_interested() : interested)
+    and not (direction == Direction::In and fd.eof());
+}
 
-  /* tell poll whether we care about each fd */
-  for ( unsigned int i = 0; i < actions_.size(); i++ ) {
-    assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-    pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-      ? actions_.at( i ).direction : 0;
+/* recompute one action's pollfds_ events */
+void Poller::refresh( const size_t index )
+{
+  const short events = actions_[ index ].wants_fd() ? actions_[ index ].direction : 0;
+  if ( events == pollfds_[ index ].events ) {
+    return;
+  }
 
-    /* don't poll in on fds that have had EOF */
-    if ( actions_.at( i ).direction == Direction::In
-	 and actions_.at( i ).fd.eof() ) {
-      pollfds_.at( i ).events = 0;
+  interested_count_ += (events ? 1 : 0) - (pollfds_[ index ].events ? 1 : 0);
+  pollfds_[ index ].events = events;
+
+  if ( backend_ == Backend::Epoll ) {
+    EpollRegistration & registration = registrations_[ registration_of_[ index ] ];
+    if ( not registration.dirty ) {
+      registration.dirty = true;
+      dirty_registrations_.push_back( registration_of_[ index ] );
     }
   }
+}
+
+/* decide which actions are interested in their fd on this iteration */
+bool Poller::update_interest()
+{
+  assert( pollfds_.size() == actions_.size() );
+
+  if ( backend_ == Backend::Epoll ) {
+    /* the rest only change through refresh() */
+    for ( const auto index : evaluated_ ) {
+      refresh( index );
+    }
+  } else {
+    /* (poll() looks at every fd anyway) */
+    for ( size_t i = 0; i < actions_.size(); i++ ) {
+      refresh( i );
+    }
+  }
+
+  /* is any member in pollfds_ interested in a non-zero direction? */
+  return interested_count_ > 0;
+}
+
+/* does an interested Error action take care of POLLERR on this fd? */
+bool Poller::handles_errors( const int fd ) const
+{
+  return any_of( pollfds_.begin(), pollfds_.end(),
+		 [&] ( const pollfd & x ) { return x.fd == fd and (x.events & POLLERR); } );
+}
+
+/* the same, looking only at the actions on one registered fd */
+bool Poller::handles_errors( const EpollRegistration & registration ) const
+{
+  return any_of( registration.action_indices.begin(), registration.action_indices.end(),
+		 [&] ( const size_t index ) { return pollfds_[ index ].events & POLLERR; } );
+}
+
+/* run a ready action's callback */
+Poller::Action::Result Poller::service( const size_t index )
+{
+  Action & action = actions_[ index ];
+
+  /* an earlier callback in this iteration may have ended its interest */
+  if ( not action.wants_fd() ) {
+    return Action::Result();
+  }
+
+  const auto count_before = action.service_count();
+  auto result = action.callback();
+
+  if ( count_before == action.service_count() ) {
+    throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+  }
+
+  if ( result.result == ResultType::Cancel ) {
+    action.active = false;
+  }
+
+  /* (cancelling, or reaching EOF, ends the action's interest) */
+  refresh( index );
+
+  return result;
+}
 
+Poller::Result Poller::poll( const int & timeout_ms )
+{
+  return backend_ == Backend::Epoll ? poll_with_epoll( timeout_ms ) : poll_with_poll( timeout_ms );
+}
+
+Poller::Result Poller::poll_with_poll( const int & timeout_ms )
+{
   /* Quit if no member in pollfds_ has a non-zero direction */
-  if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-		       [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+  if ( not update_interest() ) {
     return Result::Type::Exit;
   }
 
   try {
-    if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
+    if ( 0 == SystemCall( "poll", ::poll( pollfds_.data(), pollfds_.size(), timeout_ms ) ) ) {
       return Result::Type::Timeout;
     }
   } catch ( unix_error const& e ) {
@@ -53,27 +195,91 @@ Poller::Result Poller::poll( const int & timeout_ms )
   }
 
   for ( unsigned int i = 0; i < pollfds_.size(); i++ ) {
-    if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
+    if ( (pollfds_[ i ].revents & (POLLHUP | POLLNVAL))
+	 or ((pollfds_[ i ].revents & POLLERR) and not handles_errors( pollfds_[ i ].fd )) ) {
       return Result::Type::Exit;
     }
 
     if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
       /* we only want to call callback if revents includes
 	 the event we asked for */
-      const auto count_before = actions_.at( i ).service_count();
-      auto result = actions_.at( i ).callback();
+      const auto result = service( i );
 
-      if ( count_before == actions_.at( i ).service_count() ) {
-	throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+      if ( result.result == ResultType::Exit ) {
+	return Result( Result::Type::Exit, result.exit_status );
       }
+    }
+  }
 
-      switch ( result.result ) {
-      case ResultType::Exit:
-	return Result( Result::Type::Exit, result.exit_status );
-      case ResultType::Cancel:
-	actions_.at( i ).active = false;
-      case ResultType::Continue:
-	break;
+  return Result::Type::Success;
+}
+
+Poller::Result Poller::poll_with_epoll( const int & timeout_ms )
+{
+  /* Quit if no action is interested in its fd */
+  if ( not update_interest() ) {
+    return Result::Type::Exit;
+  }
+
+  /* only tell the kernel about fds whose combined interest changed */
+  for ( const auto i : dirty_registrations_ ) {
+    EpollRegistration & registration = registrations_[ i ];
+    registration.dirty = false;
+
+    uint32_t events = 0;
+    for ( const auto index : registration.action_indices ) {
+      if ( pollfds_[ index ].events & POLLIN ) { events |= EPOLLIN; }
+      if ( pollfds_[ index ].events & POLLOUT ) { events |= EPOLLOUT; }
+    }
+
+    if ( events != registration.events ) {
+      epoll_event event;
+      zero( event );
+      event.events = events;
+      event.data.u32 = i;
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD,
+					  registration.fd, &event ) );
+      registration.events = events;
+    }
+  }
+  dirty_registrations_.clear();
+
+  int ready_count = 0;
+  try {
+    ready_count = SystemCall( "epoll_wait", epoll_wait( epoll_fd_.fd_num(), ready_events_.data(),
+							 ready_events_.size(), timeout_ms ) );
+    if ( ready_count == 0 ) {
+      return Result::Type::Timeout;
+    }
+  } catch ( unix_error const& e ) {
+    if ( e.code().value() == EINTR ) {
+      return Result::Type::Exit;
+    }
+  }
+
+  /* only visit the fds the kernel reported as ready */
+  for ( int i = 0; i < ready_count; i++ ) {
+    const epoll_event & event = ready_events_[ i ];
+    const EpollRegistration & registration = registrations_.at( event.data.u32 );
+
+    if ( (event.events & EPOLLHUP)
+	 or ((event.events & EPOLLERR) and not handles_errors( registration )) ) {
+      return Result::Type::Exit;
+    }
+
+    for ( const auto index : registration.action_indices ) {
+      const short revents = ((event.events & EPOLLIN) ? POLLIN : 0)
+	| ((event.events & EPOLLOUT) ? POLLOUT : 0)
+	| ((event.events & EPOLLERR) ? POLLERR : 0);
+
+      /* we only want to call callback if the fd is ready
+	 in the direction this action asked for */
+      if ( revents & pollfds_[ index ].events ) {
+	const auto result = service( index );
+
+	if ( result.result == ResultType::Exit ) {
+	  return Result( Result::Type::Exit, result.exit_status );
+	}
       }
     }
   }
@@ -5,12 +5,17 @@
 #include <vector>
 
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include "file_descriptor.hh"
+#include "timer.hh"
 
 class Poller
 {
 public:
+  /* kernel interface used to wait for events */
+  enum class Backend { Poll, Epoll };
+
   struct Action
   {
     struct Result
@@ -24,25 +29,71 @@ public:
     typedef std::function<Result(void)> CallbackType;
 
     FileDescriptor & fd;
-    enum PollDirection : short { In = POLLIN, Out = POLLOUT } direction;
+    /* Error means "the fd has something on its error queue"; POLLERR on an
+       fd without an interested Error action still ends the loop */
+    enum PollDirection : short { In = POLLIN, Out = POLLOUT, Error = POLLERR } direction;
     CallbackType callback;
+
+    /* asked before every poll, if given; otherwise the action is
+       interested until told otherwise with Poller::set_interest(), and
+       costs nothing on iterations where that doesn't happen */
     std::function<bool(void)> when_interested;
     bool active;
+    bool interested; /* (without when_interested) */
 
     Action( FileDescriptor & s_fd,
 	    const PollDirection & s_direction,
 	    const CallbackType & s_callback,
-	    const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+	    const std::function<bool(void)> & s_when_interested = nullptr )
       : fd( s_fd ), direction( s_direction ), callback( s_callback ),
-	when_interested( s_when_interested ), active( true ) {}
+	when_interested( s_when_interested ), active( true ), interested( true ) {}
 
     unsigned int service_count() const;
+
+    /* should the fd be polled for this action now? */
+    bool wants_fd() const;
   };
 
 private:
+  Backend backend_;
   std::vector< Action > actions_;
   std::vector< pollfd > pollfds_;
 
+  /* actions with a when_interested() to ask on every iteration */
+  std::vector< size_t > evaluated_;
+
+  /* actions whose pollfds_ entry has any events */
+  size_t interested_count_;
+
+  /* epoll registration, shared by every action on the same fd */
+  struct EpollRegistration
+  {
+    int fd;
+    uint32_t events; /* interest currently registered with the kernel */
+    std::vector< size_t > action_indices;
+    bool dirty; /* an action's interest changed since the last epoll_ctl */
+  };
+
+  FileDescriptor epoll_fd_;
+  std::vector< EpollRegistration > registrations_;
+  std::vector< size_t > registration_of_; /* for each action */
+  std::vector< size_t > dirty_registrations_;
+  std::vector< epoll_event > ready_events_;
+
+  /* recompute one action's pollfds_ events (and mark its registration
+     for an epoll_ctl if they changed) */
+  void refresh( const size_t index );
+
+  /* decide which actions are interested in their fd on this iteration */
+  bool update_interest();
+
+  /* does an interested Error action take care of POLLERR on this fd? */
+  bool handles_errors( const int fd ) const;
+  bool handles_errors( const EpollRegistration & registration ) const;
+
+  /* run a ready action's callback */
+  Action::Result service( const size_t index );
+
 public:
   struct Result
   {
@@ -52,9 +103,25 @@ public:
       : result( s_result ), exit_status( s_status ) {}
   };
 
-  Poller() : actions_(), pollfds_() {}
-  void add_action( Action action );
+  Poller( const Backend & backend = Backend::Poll );
+
+  /* returns the action's index, for set_interest() */
+  size_t add_action( Action action );
+
+  /* start or stop polling for an action without a when_interested()
+     (with the epoll backend, the only per-iteration cost of interest is
+     for actions that do have one, and for those changed here) */
+  void set_interest( const size_t index, const bool interested );
+
+  /* run callback each time timer expires (the Poller reads the
+     expirations first; the callback may re-arm or disarm the timer) */
+  void add_timer_action( Timer & timer, const Action::CallbackType & callback );
+
   Result poll( const int & timeout_ms );
+
+private:
+  Result poll_with_poll( const int & timeout_ms );
+  Result poll_with_epoll( const int & timeout_ms );
 };
 
 namespace PollerShortNames {
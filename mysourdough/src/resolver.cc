@@ -0,0 +1,120 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "resolver.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+Resolver::Resolver()
+  : FileDescriptor( SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) ),
+    mutex_(),
+    wakeup_(),
+    waiting_(),
+    finished_(),
+    stopping_( false ),
+    outstanding_( 0 ),
+    helper_( &Resolver::work, this )
+{}
+
+Resolver::~Resolver()
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+
+  /* (waits for a lookup already under way to finish) */
+  wakeup_.notify_one();
+  helper_.join();
+}
+
+/* queue a lookup for the helper thread */
+void Resolver::resolve( const string & hostname, const string & service,
+			const Callback & callback, const ErrorCallback & error_callback )
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    waiting_.push_back( { hostname, service, callback, error_callback, Address(), nullptr } );
+  }
+
+  outstanding_++;
+  wakeup_.notify_one();
+}
+
+/* the helper thread's loop */
+void Resolver::work()
+{
+  unique_lock<mutex> lock( mutex_ );
+
+  while ( true ) {
+    wakeup_.wait( lock, [&] () { return stopping_ or not waiting_.empty(); } );
+    if ( stopping_ ) {
+      return;
+    }
+
+    Lookup lookup = move( waiting_.front() );
+    waiting_.pop_front();
+
+    /* don't hold up resolve() while getaddrinfo() blocks */
+    lock.unlock();
+    try {
+      lookup.address = Address( lookup.hostname, lookup.service );
+    } catch ( const exception & ) {
+      lookup.error = current_exception();
+    }
+    lock.lock();
+
+    finished_.push_back( move( lookup ) );
+
+    /* wake the event loop (EAGAIN means the count is full, so it's awake
+       already; any other failure goes back with the lookup, since
+       throwing here would end the program) */
+    const uint64_t one = 1;
+    if ( ::write( fd_num(), &one, sizeof( one ) ) != sizeof( one ) and errno != EAGAIN ) {
+      finished_.back().error = make_exception_ptr( unix_error( "write (eventfd)" ) );
+    }
+  }
+}
+
+/* run the callbacks of every finished lookup */
+void Resolver::deliver()
+{
+  uint64_t count;
+  if ( ::read( fd_num(), &count, sizeof( count ) ) < 0 and errno != EAGAIN ) {
+    throw unix_error( "read (eventfd)" );
+  }
+  register_read();
+
+  deque<Lookup> finished;
+  {
+    unique_lock<mutex> lock( mutex_ );
+    finished.swap( finished_ );
+  }
+
+  for ( const auto & lookup : finished ) {
+    outstanding_--;
+
+    if ( lookup.error ) {
+      try {
+	rethrow_exception( lookup.error );
+      } catch ( const exception & e ) {
+	lookup.error_callback( e );
+      }
+    } else {
+      lookup.callback( lookup.address );
+    }
+  }
+}
+
+/* add an action that calls deliver() as lookups finish */
+void Resolver::add_action( Poller & poller )
+{
+  poller.add_action( Action( *this, Direction::In,
+			     [&] () {
+			       deliver();
+			       return ResultType::Continue;
+			     },
+			     [&] () { return outstanding_ > 0; } ) );
+}
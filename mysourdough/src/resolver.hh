@@ -0,0 +1,71 @@
+#ifndef RESOLVER_HH
+#define RESOLVER_HH
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "address.hh"
+#include "file_descriptor.hh"
+#include "poller.hh"
+#include "util.hh"
+
+/* Name lookups off the event loop. A helper thread runs the blocking
+   getaddrinfo() (via the Address constructor) for each resolve(), and
+   the event loop gets the answers through the Resolver's fd (an
+   eventfd), which becomes readable when lookups finish. deliver() then
+   runs their callbacks on the event loop's own thread. */
+class Resolver : public FileDescriptor
+{
+public:
+  typedef std::function<void( const Address & )> Callback;
+  typedef std::function<void( const std::exception & )> ErrorCallback;
+
+private:
+  struct Lookup
+  {
+    std::string hostname, service;
+    Callback callback;
+    ErrorCallback error_callback;
+    Address address;
+    std::exception_ptr error;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Lookup> waiting_; /* for the helper thread */
+  std::deque<Lookup> finished_; /* for deliver() */
+  bool stopping_;
+
+  /* lookups not yet delivered (only touched by the event loop's thread) */
+  size_t outstanding_;
+
+  std::thread helper_;
+
+  /* the helper thread's loop */
+  void work();
+
+public:
+  Resolver();
+  ~Resolver();
+
+  /* look up hostname and service; callback (or error_callback, if the
+     lookup fails) will run from deliver() */
+  void resolve( const std::string & hostname, const std::string & service,
+		const Callback & callback,
+		const ErrorCallback & error_callback = [] ( const std::exception & e ) { print_exception( e ); } );
+
+  size_t outstanding() const { return outstanding_; }
+
+  /* run the callbacks of every finished lookup */
+  void deliver();
+
+  /* add an action that calls deliver() as lookups finish */
+  void add_action( Poller & poller );
+};
+
+#endif /* RESOLVER_HH */
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ring_buffer.hh"
+
+using namespace std;
+
+/* copy out (only when the caller really wants a string) */
+string buffer_view::to_string() const
+{
+  string ret;
+  ret.reserve( size() );
+  ret.append( first, first_length );
+  ret.append( second, second_length );
+  return ret;
+}
+
+RingBuffer::RingBuffer( const size_t capacity )
+  : storage_( capacity ),
+    head_( 0 ),
+    size_( 0 )
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "RingBuffer: capacity must be positive" );
+  }
+}
+
+/* view of length bytes starting offset bytes after the oldest one */
+buffer_view RingBuffer::view( const size_t offset, const size_t length ) const
+{
+  const size_t start = (head_ + offset) % capacity();
+  const size_t first_length = min( length, capacity() - start );
+
+  return { &storage_[ start ], first_length,
+	   &storage_[ 0 ], length - first_length };
+}
+
+/* the newest length bytes held */
+buffer_view RingBuffer::newest( const size_t length ) const
+{
+  if ( length > size_ ) {
+    throw runtime_error( "RingBuffer: not that many bytes held" );
+  }
+
+  return view( size_ - length, length );
+}
+
+/* describe the free space as (at most) two iovecs for readv(); returns how many */
+int RingBuffer::writable( iovec ( & regions )[ 2 ] )
+{
+  const size_t tail = (head_ + size_) % capacity();
+  const size_t first_length = min( free_space(), capacity() - tail );
+
+  regions[ 0 ].iov_base = &storage_[ tail ];
+  regions[ 0 ].iov_len = first_length;
+  regions[ 1 ].iov_base = &storage_[ 0 ];
+  regions[ 1 ].iov_len = free_space() - first_length;
+
+  return regions[ 1 ].iov_len ? 2 : 1;
+}
+
+/* length bytes were written into the writable regions */
+void RingBuffer::produce( const size_t length )
+{
+  if ( length > free_space() ) {
+    throw runtime_error( "RingBuffer: overflow" );
+  }
+
+  size_ += length;
+}
+
+/* drop the length oldest bytes */
+void RingBuffer::consume( const size_t length )
+{
+  if ( length > size_ ) {
+    throw runtime_error( "RingBuffer: not that many bytes held" );
+  }
+
+  head_ = (head_ + length) % capacity();
+  size_ -= length;
+
+  /* start over at the front, so the next read is more likely to be contiguous */
+  if ( size_ == 0 ) {
+    head_ = 0;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef RING_BUFFER_HH
+#define RING_BUFFER_HH
+
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+/* bytes owned by a RingBuffer, in (at most) two contiguous pieces */
+struct buffer_view
+{
+  const char * first;
+  size_t first_length;
+  const char * second;
+  size_t second_length;
+
+  size_t size() const { return first_length + second_length; }
+
+  /* copy out (only when the caller really wants a string) */
+  std::string to_string() const;
+};
+
+/* fixed-capacity circular byte buffer, reused across reads */
+class RingBuffer
+{
+private:
+  std::vector<char> storage_;
+  size_t head_; /* offset of the oldest byte held */
+  size_t size_; /* number of bytes held */
+
+  /* view of length bytes starting offset bytes after the oldest one */
+  buffer_view view( const size_t offset, const size_t length ) const;
+
+public:
+  RingBuffer( const size_t capacity );
+
+  size_t capacity() const { return storage_.size(); }
+  size_t size() const { return size_; }
+  size_t free_space() const { return capacity() - size_; }
+
+  /* every byte held, oldest first */
+  buffer_view readable() const { return view( 0, size_ ); }
+
+  /* the newest length bytes held */
+  buffer_view newest( const size_t length ) const;
+
+  /* describe the free space as (at most) two iovecs for readv(); returns how many */
+  int writable( iovec ( & regions )[ 2 ] );
+
+  /* length bytes were written into the writable regions */
+  void produce( const size_t length );
+
+  /* drop the length oldest bytes */
+  void consume( const size_t length );
+};
+
+#endif /* RING_BUFFER_HH */
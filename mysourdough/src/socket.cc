@@ -1,19 +1,28 @@
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 #include "socket.hh"
 #include "util.hh"
 #include "timestamp.hh"
 
 using namespace std;
+using namespace PollerShortNames;
 
 /* default constructor for socket of (subclassed) domain and type */
 Socket::Socket( const int domain, const int type )
-  : FileDescriptor( SystemCall( "socket", socket( domain, type, 0 ) ) )
+  : FileDescriptor( SystemCall( "socket", socket( domain, type, 0 ) ) ),
+    zerocopy_( false ), zerocopy_next_id_( 0 ), zerocopy_completed_( 0 ),
+    zerocopy_done_(), zerocopy_pinned_(), zerocopy_copies_( 0 )
 {}
 
 /* construct from file descriptor */
 Socket::Socket( FileDescriptor && fd, const int domain, const int type )
-  : FileDescriptor( move( fd ) )
+  : FileDescriptor( move( fd ) ),
+    zerocopy_( false ), zerocopy_next_id_( 0 ), zerocopy_completed_( 0 ),
+    zerocopy_done_(), zerocopy_pinned_(), zerocopy_copies_( 0 )
 {
   int actual_value;
   socklen_t len;
@@ -75,67 +84,218 @@ void Socket::connect( const Address & address )
 				    address.size() ) );
 }
 
-/* receive datagram and where it came from */
-UDPSocket::received_datagram UDPSocket::recv()
+/* what the kernel told us about a received datagram */
+struct received_metadata
+{
+  uint64_t timestamp;
+  uint64_t timestamp_ns;
+  size_t segment_size; /* zero unless GRO coalesced several datagrams */
+};
+
+/* the software time out of an SO_TIMESTAMPING control message (ts[ 0 ],
+   on the system clock; a raw hardware time in ts[ 2 ] would be on the
+   NIC's own clock, which timestamp_ns() can't compare with anything) */
+static uint64_t timestamping_ns( const cmsghdr & hdr )
 {
-  static const ssize_t RECEIVE_MTU = 65536;
+  scm_timestamping times;
+  memcpy( &times, CMSG_DATA( &hdr ), sizeof( times ) );
 
-  /* receive source address, timestamp and payload */
-  Address::raw datagram_source_address;
-  msghdr header; zero( header );
-  iovec msg_iovec; zero( msg_iovec );
+  return timestamp_ns( times.ts[ 0 ] );
+}
 
-  char msg_payload[ RECEIVE_MTU ];
-  char msg_control[ RECEIVE_MTU ];
+/* check the flags of a received datagram and parse its control messages */
+static received_metadata parse_received( msghdr & header )
+{
+  /* make sure we got the whole datagram */
+  if ( header.msg_flags & MSG_TRUNC ) {
+    throw runtime_error( "recvfrom (oversized datagram)" );
+  } else if ( header.msg_flags ) {
+    throw runtime_error( "recvfrom (unhandled flag)" );
+  }
 
-  /* prepare to get the source address */
-  header.msg_name = &datagram_source_address;
-  header.msg_namelen = sizeof( datagram_source_address );
+  received_metadata ret = { uint64_t( -1 ), uint64_t( -1 ), 0 };
+
+  /* find the timestamp and GRO headers (if there are any) */
+  cmsghdr *hdr = CMSG_FIRSTHDR( &header );
+  while ( hdr ) {
+    if ( hdr->cmsg_level == SOL_SOCKET
+	 and hdr->cmsg_type == SO_TIMESTAMPNS ) {
+      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( hdr ) );
+      ret.timestamp_ns = timestamp_ns( *kernel_time );
+      ret.timestamp = ret.timestamp_ns / 1000000;
+    } else if ( hdr->cmsg_level == SOL_SOCKET
+		and hdr->cmsg_type == SCM_TIMESTAMPING ) {
+      ret.timestamp_ns = timestamping_ns( *hdr );
+      ret.timestamp = ret.timestamp_ns / 1000000;
+    } else if ( hdr->cmsg_level == SOL_UDP
+		and hdr->cmsg_type == UDP_GRO ) {
+      int segment_size;
+      memcpy( &segment_size, CMSG_DATA( hdr ), sizeof( segment_size ) );
+      ret.segment_size = segment_size;
+    }
+    hdr = CMSG_NXTHDR( &header, hdr );
+  }
 
-  /* prepare to get the payload */
-  msg_iovec.iov_base = msg_payload;
-  msg_iovec.iov_len = sizeof( msg_payload );
-  header.msg_iov = &msg_iovec;
-  header.msg_iovlen = 1;
+  return ret;
+}
 
-  /* prepare to get the timestamp */
-  header.msg_control = msg_control;
-  header.msg_controllen = sizeof( msg_control );
+/* room for up to max_datagrams messages per receive */
+UDPSocket::ReceiveBuffer::ReceiveBuffer( const size_t max_datagrams )
+  : storage_( max_datagrams * (RECEIVE_MTU + CONTROL_SIZE) ),
+    source_addresses_( max_datagrams ),
+    iovecs_( max_datagrams ),
+    headers_( max_datagrams ),
+    datagrams_()
+{
+  if ( max_datagrams == 0 ) {
+    throw runtime_error( "ReceiveBuffer: max_datagrams must be positive" );
+  }
 
-  /* call recvmsg */
-  ssize_t recv_len = SystemCall( "recvmsg",
-				 recvmsg( fd_num(), &header, 0 ) );
+  /* payloads first, then the control data */
+  for ( size_t i = 0; i < max_datagrams; i++ ) {
+    iovecs_[ i ].iov_base = &storage_[ i * RECEIVE_MTU ];
+    iovecs_[ i ].iov_len = RECEIVE_MTU;
+
+    msghdr & header = headers_[ i ].msg_hdr;
+    header.msg_name = &source_addresses_[ i ];
+    header.msg_iov = &iovecs_[ i ];
+    header.msg_iovlen = 1;
+    header.msg_control = &storage_[ max_datagrams * RECEIVE_MTU + i * CONTROL_SIZE ];
+  }
+
+  datagrams_.reserve( max_datagrams );
+}
+
+/* fill buffer with up to max_datagrams messages using one recvmmsg(),
+   splitting GRO-coalesced messages; returns the number of datagrams */
+size_t UDPSocket::recv_into( ReceiveBuffer & buffer, const size_t max_datagrams, const int flags )
+{
+  if ( max_datagrams == 0 or max_datagrams > buffer.capacity() ) {
+    throw runtime_error( "recv_batch: invalid number of datagrams" );
+  }
+
+  /* the kernel overwrites these lengths on every receive */
+  for ( size_t i = 0; i < max_datagrams; i++ ) {
+    msghdr & header = buffer.headers_[ i ].msg_hdr;
+    header.msg_namelen = sizeof( buffer.source_addresses_[ i ] );
+    header.msg_controllen = CONTROL_SIZE;
+    header.msg_flags = 0;
+  }
+
+  const int ret = recvmmsg( fd_num(), &buffer.headers_[ 0 ], max_datagrams, flags, nullptr );
 
   register_read();
 
-  /* make sure we got the whole datagram */
-  if ( header.msg_flags & MSG_TRUNC ) {
-    throw runtime_error( "recvfrom (oversized datagram)" );
-  } else if ( header.msg_flags ) {
-    throw runtime_error( "recvfrom (unhandled flag)" );
+  buffer.datagrams_.clear();
+
+  /* a nonblocking receive finding nothing queued isn't an error */
+  if ( ret < 0 and (flags & MSG_DONTWAIT) and (errno == EAGAIN or errno == EWOULDBLOCK) ) {
+    return 0;
+  }
+
+  const int count = SystemCall( "recvmmsg", ret );
+  for ( int i = 0; i < count; i++ ) {
+    msghdr & header = buffer.headers_[ i ].msg_hdr;
+    parse_message( header,
+		   Address( buffer.source_addresses_[ i ], header.msg_namelen ),
+		   static_cast<const char *>( buffer.iovecs_[ i ].iov_base ),
+		   buffer.headers_[ i ].msg_len,
+		   buffer.datagrams_ );
   }
 
-  uint64_t timestamp = -1;
+  return buffer.datagrams_.size();
+}
+
+/* turn a received message into datagrams (splitting it if GRO coalesced several) */
+void UDPSocket::parse_message( msghdr & header,
+			       const Address & source_address,
+			       const char * payload,
+			       const size_t length,
+			       vector<datagram_view> & datagrams )
+{
+  const received_metadata metadata = parse_received( header );
+
+  /* split a GRO-coalesced buffer back into its datagrams,
+     which all share the kernel timestamp */
+  const size_t segment_size = metadata.segment_size ? metadata.segment_size : length;
+  size_t offset = 0;
+  do {
+    datagrams.push_back( { source_address,
+			   metadata.timestamp,
+			   metadata.timestamp_ns,
+			   payload + offset,
+			   min( segment_size, length - offset ) } );
+    offset += segment_size;
+  } while ( offset < length );
+}
+
+/* copy the most recently received datagrams out of recv_buffer_ */
+UDPSocket::received_datagram UDPSocket::copy_datagram( const size_t i ) const
+{
+  const datagram_view & view = (*recv_buffer_)[ i ];
+
+  received_datagram ret = { view.source_address,
+			    view.timestamp,
+			    view.timestamp_ns,
+			    string( view.payload, view.payload_length ) };
+
+  return ret;
+}
 
-  /* find the timestamp header (if there is one) */
-  cmsghdr *ts_hdr = CMSG_FIRSTHDR( &header );
-  while ( ts_hdr ) {
-    if ( ts_hdr->cmsg_level == SOL_SOCKET
-	 and ts_hdr->cmsg_type == SO_TIMESTAMPNS ) {
-      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( ts_hdr ) );
-      timestamp = timestamp_ms( *kernel_time );
+/* receive datagram and where it came from */
+UDPSocket::received_datagram UDPSocket::recv()
+{
+  if ( not recv_buffer_ ) {
+    recv_buffer_.reset( new ReceiveBuffer( 1 ) );
+  }
+
+  /* GRO may have handed us several datagrams last time */
+  if ( recv_buffer_next_ >= recv_buffer_->size() ) {
+    recv_into( *recv_buffer_, 1, 0 );
+    recv_buffer_next_ = 0;
+  }
+
+  return copy_datagram( recv_buffer_next_++ );
+}
+
+/* receive between one and max_datagrams datagrams with a single syscall */
+vector<UDPSocket::received_datagram> UDPSocket::recv_batch( const size_t max_datagrams )
+{
+  /* first hand out anything left over from a previous recv() */
+  if ( not recv_buffer_ or recv_buffer_next_ >= recv_buffer_->size() ) {
+    /* grow (but never shrink) the storage reused across calls */
+    if ( not recv_buffer_ or recv_buffer_->capacity() < max_datagrams ) {
+      recv_buffer_.reset( new ReceiveBuffer( max_datagrams ) );
     }
-    ts_hdr = CMSG_NXTHDR( &header, ts_hdr );
+
+    /* block for the first datagram, then take whatever else is queued */
+    recv_into( *recv_buffer_, max_datagrams, MSG_WAITFORONE );
+    recv_buffer_next_ = 0;
   }
 
-  received_datagram ret = { Address( datagram_source_address,
-				     header.msg_namelen ),
-			    timestamp,
-			    string( msg_payload, recv_len ) };
+  vector<received_datagram> ret;
+  ret.reserve( recv_buffer_->size() - recv_buffer_next_ );
+
+  while ( recv_buffer_next_ < recv_buffer_->size() ) {
+    ret.push_back( copy_datagram( recv_buffer_next_++ ) );
+  }
 
   return ret;
 }
 
+/* receive between one and buffer.capacity() datagrams into buffer,
+   without allocating or copying */
+size_t UDPSocket::recv_batch( ReceiveBuffer & buffer )
+{
+  return recv_into( buffer, buffer.capacity(), MSG_WAITFORONE );
+}
+
+/* same, but without blocking: returns zero once nothing is queued */
+size_t UDPSocket::try_recv_batch( ReceiveBuffer & buffer )
+{
+  return recv_into( buffer, buffer.capacity(), MSG_DONTWAIT );
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
@@ -148,6 +308,7 @@ void UDPSocket::sendto( const Address & destination, const string & payload )
 				    destination.size() ) );
 
   register_write();
+  tx_id_++;
 
   if ( size_t( bytes_sent ) != payload.size() ) {
     throw runtime_error( "datagram payload too big for sendto()" );
@@ -164,12 +325,121 @@ void UDPSocket::send( const string & payload )
 				0 ) );
 
   register_write();
+  tx_id_++;
 
   if ( size_t( bytes_sent ) != payload.size() ) {
     throw runtime_error( "datagram payload too big for send()" );
   }
 }
 
+/* send datagram to connected address, from the payload itself if zerocopy is on */
+void UDPSocket::send( string && payload )
+{
+  if ( not zerocopy() or payload.size() < ZEROCOPY_MIN_SIZE ) {
+    send( payload );
+    return;
+  }
+
+  /* pin the payload first, so the kernel reads it where it will stay
+     (if the send fails, it stays pinned until the next one completes) */
+  const string & pinned = pin( move( payload ), zerocopy_next_id() );
+
+  const ssize_t bytes_sent =
+    SystemCall( "send", ::send( fd_num(),
+				pinned.data(),
+				pinned.size(),
+				MSG_ZEROCOPY ) );
+
+  register_write();
+  tx_id_++;
+  zerocopy_sent();
+
+  if ( size_t( bytes_sent ) != pinned.size() ) {
+    throw runtime_error( "datagram payload too big for send()" );
+  }
+}
+
+/* send several datagrams to connected address with as few syscalls as possible */
+vector<uint32_t> UDPSocket::send_batch( const string * payloads, const size_t count )
+{
+  vector<uint32_t> tx_ids;
+  tx_ids.reserve( count );
+
+  vector<iovec> msg_iovecs( count );
+  vector<mmsghdr> headers;
+  vector<size_t> message_lengths;
+  vector<char> control( count * CMSG_SPACE( sizeof( uint16_t ) ) );
+
+  headers.reserve( count );
+  message_lengths.reserve( count );
+
+  /* group the datagrams into messages; with GSO, a run of datagrams of
+     the same size becomes one buffer that the kernel splits back up */
+  size_t i = 0;
+  while ( i < count ) {
+    const size_t segment_size = payloads[ i ].size();
+    size_t segments = 0, message_length = 0;
+
+    do {
+      msg_iovecs[ i + segments ].iov_base = const_cast<char *>( payloads[ i + segments ].data() );
+      msg_iovecs[ i + segments ].iov_len = segment_size;
+      message_length += segment_size;
+      segments++;
+    } while ( gso_enabled_
+	      and i + segments < count
+	      and segments < GSO_MAX_SEGMENTS
+	      and payloads[ i + segments ].size() == segment_size
+	      and message_length + segment_size <= GSO_MAX_BYTES );
+
+    mmsghdr message;
+    zero( message );
+    message.msg_hdr.msg_iov = &msg_iovecs[ i ];
+    message.msg_hdr.msg_iovlen = segments;
+
+    /* tell the kernel where to cut the buffer */
+    if ( segments > 1 ) {
+      message.msg_hdr.msg_control = &control[ headers.size() * CMSG_SPACE( sizeof( uint16_t ) ) ];
+      message.msg_hdr.msg_controllen = CMSG_SPACE( sizeof( uint16_t ) );
+
+      cmsghdr * const gso_hdr = CMSG_FIRSTHDR( &message.msg_hdr );
+      gso_hdr->cmsg_level = SOL_UDP;
+      gso_hdr->cmsg_type = UDP_SEGMENT;
+      gso_hdr->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+      const uint16_t gso_size = segment_size;
+      memcpy( CMSG_DATA( gso_hdr ), &gso_size, sizeof( gso_size ) );
+    }
+
+    headers.push_back( message );
+    message_lengths.push_back( message_length );
+    i += segments;
+
+    /* the kernel counts messages, so a GSO buffer's datagrams share an id */
+    tx_ids.insert( tx_ids.end(), segments, tx_id_ + headers.size() - 1 );
+  }
+
+  /* sendmmsg() may stop early (e.g. at UIO_MAXIOV), so keep going until done */
+  size_t sent = 0;
+  while ( sent < headers.size() ) {
+    const int count = SystemCall( "sendmmsg",
+				  sendmmsg( fd_num(), &headers[ sent ],
+					    headers.size() - sent, 0 ) );
+
+    register_write();
+
+    for ( int j = 0; j < count; j++ ) {
+      if ( headers[ sent + j ].msg_len != message_lengths[ sent + j ] ) {
+	throw runtime_error( "datagram payload too big for sendmmsg()" );
+      }
+    }
+
+    sent += count;
+  }
+
+  tx_id_ += headers.size();
+
+  return tx_ids;
+}
+
 /* mark the socket as listening for incoming connections */
 void TCPSocket::listen( const int backlog )
 {
@@ -183,6 +453,243 @@ TCPSocket TCPSocket::accept()
   return TCPSocket( FileDescriptor( SystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) ) );
 }
 
+/* accept every connection waiting on a nonblocking listening socket */
+vector<TCPSocket> TCPSocket::accept_pending()
+{
+  vector<TCPSocket> connections;
+
+  while ( true ) {
+    const int fd = accept4( fd_num(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+    if ( fd < 0 ) {
+      if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+	break;
+      } else if ( errno == ECONNABORTED ) { /* gone before we got to it */
+	continue;
+      }
+      throw unix_error( "accept4" );
+    }
+
+    connections.emplace_back( TCPSocket( FileDescriptor( fd ) ) );
+  }
+
+  register_read();
+  return connections;
+}
+
+/* queue data to be written by flush() */
+void TCPSocket::queue_write( string && data )
+{
+  if ( data.empty() ) {
+    return;
+  }
+
+  queued_bytes_ += data.size();
+  output_.push_back( move( data ) );
+}
+
+/* write queued data until the kernel would block */
+bool TCPSocket::flush()
+{
+  while ( not output_.empty() ) {
+    /* with zerocopy, each sendmsg() hands over either only buffers big
+       enough to stay put when pinned, or only smaller ones (copied) */
+    const auto pinnable = [&] ( const string & x ) {
+      return zerocopy() and x.size() >= ZEROCOPY_MIN_SIZE;
+    };
+    const bool zerocopy_regions = pinnable( output_.front() );
+
+    iovec regions[ MAX_FLUSH_BUFFERS ];
+    size_t region_count = 0;
+    for ( auto it = output_.begin();
+	  it != output_.end() and region_count < MAX_FLUSH_BUFFERS
+	    and pinnable( *it ) == zerocopy_regions;
+	  ++it, ++region_count ) {
+      const size_t offset = (region_count == 0) ? output_offset_ : 0;
+      regions[ region_count ].iov_base = const_cast<char *>( it->data() ) + offset;
+      regions[ region_count ].iov_len = it->size() - offset;
+    }
+
+    /* sendmsg() is writev() with flags: a closed peer gets us EPIPE, not SIGPIPE */
+    msghdr header;
+    zero( header );
+    header.msg_iov = regions;
+    header.msg_iovlen = region_count;
+
+    const ssize_t bytes_written = ::sendmsg( fd_num(), &header,
+					     MSG_NOSIGNAL | (zerocopy_regions ? MSG_ZEROCOPY : 0) );
+    register_write();
+
+    if ( bytes_written < 0 ) {
+      /* (with zerocopy, ENOBUFS means too much is pinned until completions come back) */
+      if ( errno == EAGAIN or errno == EWOULDBLOCK or (zerocopy_regions and errno == ENOBUFS) ) {
+	break;
+      }
+      throw unix_error( "sendmsg" );
+    }
+
+    const uint32_t send_id = zerocopy_regions ? zerocopy_sent() : 0;
+
+    /* drop what the kernel took */
+    queued_bytes_ -= bytes_written;
+    size_t remaining = bytes_written;
+    while ( remaining > 0 ) {
+      const size_t front_remaining = output_.front().size() - output_offset_;
+      if ( remaining < front_remaining ) {
+	output_offset_ += remaining;
+	break;
+      }
+
+      remaining -= front_remaining;
+      if ( zerocopy_regions ) { /* the kernel may still be sending from it */
+	pin( move( output_.front() ), send_id );
+      }
+      output_.pop_front();
+      output_offset_ = 0;
+    }
+  }
+
+  return output_.empty();
+}
+
+/* send part of a file with sendfile(), after anything queued */
+size_t TCPSocket::send_file( FileDescriptor & file, const off_t offset, const size_t length )
+{
+  /* queued data goes first */
+  if ( not flush() ) {
+    return 0;
+  }
+
+  off_t file_offset = offset;
+  const ssize_t bytes_sent = ::sendfile( fd_num(), file.fd_num(), &file_offset, length );
+  register_write();
+
+  if ( bytes_sent < 0 ) {
+    if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+      return 0;
+    }
+    throw unix_error( "sendfile" );
+  }
+
+  return bytes_sent;
+}
+
+/* drain the error queue without blocking, handling zerocopy completions */
+void Socket::recv_error_queue( const function<void( msghdr & )> & other )
+{
+  for ( bool drained_any = false; ; drained_any = true ) {
+    msghdr header;
+    zero( header );
+    char msg_control[ ERROR_CONTROL_SIZE ];
+    header.msg_control = msg_control;
+    header.msg_controllen = sizeof( msg_control );
+
+    if ( recvmsg( fd_num(), &header, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) {
+      if ( errno != EAGAIN and errno != EWOULDBLOCK ) {
+	throw unix_error( "recvmsg (error queue)" );
+      }
+
+      /* the queue accounts for POLLERR if it held anything; only an
+	 empty one means POLLERR came from a pending socket error instead
+	 (which, still pending, raises POLLERR again once the queue is empty) */
+      if ( drained_any ) {
+	break;
+      }
+
+      int error = 0;
+      socklen_t len = sizeof( error );
+      SystemCall( "getsockopt",
+		  getsockopt( fd_num(), SOL_SOCKET, SO_ERROR, &error, &len ) );
+      if ( error ) {
+	throw unix_error( "socket error", error );
+      }
+      break;
+    }
+
+    register_read();
+
+    /* a zerocopy completion is the only control message when there is one */
+    const cmsghdr * hdr = CMSG_FIRSTHDR( &header );
+    if ( hdr
+	 and ((hdr->cmsg_level == SOL_IP and hdr->cmsg_type == IP_RECVERR)
+	      or (hdr->cmsg_level == SOL_IPV6 and hdr->cmsg_type == IPV6_RECVERR)) ) {
+      const sock_extended_err * error = reinterpret_cast<const sock_extended_err *>( CMSG_DATA( hdr ) );
+      if ( error->ee_origin == SO_EE_ORIGIN_ZEROCOPY ) {
+	if ( error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) {
+	  zerocopy_copies_ += error->ee_data - error->ee_info + 1;
+	}
+	zerocopy_complete( error->ee_info, error->ee_data );
+	continue;
+      }
+    }
+
+    other( header );
+  }
+}
+
+/* turn on SO_ZEROCOPY, so large sends can pass MSG_ZEROCOPY */
+void Socket::set_zerocopy()
+{
+  setsockopt( SOL_SOCKET, SO_ZEROCOPY, int( true ) );
+  zerocopy_ = true;
+}
+
+/* keep buffer alive until send last_id (and every send before it) completes */
+const string & Socket::pin( string && buffer, const uint32_t last_id )
+{
+  /* (a deque never moves its elements as others come and go) */
+  zerocopy_pinned_.emplace_back( last_id, move( buffer ) );
+  return zerocopy_pinned_.back().second;
+}
+
+/* the kernel finished with zerocopy sends first_id through last_id */
+void Socket::zerocopy_complete( const uint32_t first_id, const uint32_t last_id )
+{
+  /* note each send as done (ids wrap, so count from zerocopy_completed_) */
+  for ( uint32_t id = first_id; int32_t( last_id - id ) >= 0; id++ ) {
+    const uint32_t offset = id - zerocopy_completed_;
+    if ( int32_t( offset ) < 0 ) { /* already accounted for */
+      continue;
+    }
+
+    if ( zerocopy_done_.size() <= offset ) {
+      zerocopy_done_.resize( offset + 1, false );
+    }
+    zerocopy_done_[ offset ] = true;
+  }
+
+  /* completions usually arrive in order; advance past every one we have */
+  while ( not zerocopy_done_.empty() and zerocopy_done_.front() ) {
+    zerocopy_done_.pop_front();
+    zerocopy_completed_++;
+  }
+
+  /* a buffer is free once every send that used it has completed */
+  while ( not zerocopy_pinned_.empty()
+	  and int32_t( zerocopy_pinned_.front().first - zerocopy_completed_ ) < 0 ) {
+    zerocopy_pinned_.pop_front();
+  }
+}
+
+/* release the buffers of completed zerocopy sends */
+size_t Socket::recv_zerocopy_completions()
+{
+  const size_t pinned_before = zerocopy_pinned_.size();
+  recv_error_queue( [] ( msghdr & ) {} );
+  return pinned_before - zerocopy_pinned_.size();
+}
+
+/* add an action that calls recv_zerocopy_completions() while any buffer is pinned */
+void Socket::add_zerocopy_action( Poller & poller )
+{
+  poller.add_action( Action( *this, Direction::Error,
+			     [&] () {
+			       recv_zerocopy_completions();
+			       return ResultType::Continue;
+			     },
+			     [&] () { return not zerocopy_pinned_.empty(); } ) );
+}
+
 /* set socket option */
 template <typename option_type>
 void Socket::setsockopt( const int level, const int option, const option_type & option_value )
@@ -197,8 +704,76 @@ void Socket::set_reuseaddr()
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+/* let several sockets bind the same port, with the kernel spreading flows across them */
+void Socket::set_reuseport()
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int( true ) );
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps()
 {
   setsockopt( SOL_SOCKET, SO_TIMESTAMPNS, int( true ) );
 }
+
+/* turn on SO_TIMESTAMPING: nanosecond software timestamps on receipt,
+   and (if transmit) transmit timestamps on the error queue */
+void UDPSocket::set_timestamping( const bool transmit )
+{
+  /* (hardware timestamps would also need SIOCSHWTSTAMP on the device,
+     and a conversion from the NIC's clock to the system's) */
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+  if ( transmit ) {
+    flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  }
+
+  setsockopt( SOL_SOCKET, SO_TIMESTAMPING, flags );
+
+  /* turning on OPT_ID restarts the kernel's count of sent datagrams */
+  tx_id_ = 0;
+}
+
+/* collect the transmit timestamps waiting on the error queue (without blocking) */
+vector<UDPSocket::tx_timestamp> UDPSocket::recv_tx_timestamps()
+{
+  vector<tx_timestamp> ret;
+
+  recv_error_queue( [&] ( msghdr & header ) {
+      /* pair the time with the id of the datagram it belongs to */
+      uint64_t time = -1;
+      const sock_extended_err * error = nullptr;
+
+      for ( cmsghdr *hdr = CMSG_FIRSTHDR( &header ); hdr; hdr = CMSG_NXTHDR( &header, hdr ) ) {
+	if ( hdr->cmsg_level == SOL_SOCKET and hdr->cmsg_type == SCM_TIMESTAMPING ) {
+	  time = timestamping_ns( *hdr );
+	} else if ( (hdr->cmsg_level == SOL_IP and hdr->cmsg_type == IP_RECVERR)
+		    or (hdr->cmsg_level == SOL_IPV6 and hdr->cmsg_type == IPV6_RECVERR) ) {
+	  error = reinterpret_cast<const sock_extended_err *>( CMSG_DATA( hdr ) );
+	}
+      }
+
+      if ( error
+	   and error->ee_origin == SO_EE_ORIGIN_TIMESTAMPING
+	   and error->ee_info == SCM_TSTAMP_SND
+	   and time != uint64_t( -1 ) ) {
+	ret.push_back( { error->ee_data, time } );
+      }
+    } );
+
+  return ret;
+}
+
+/* let send_batch() use UDP generic segmentation offload (UDP_SEGMENT) */
+void UDPSocket::set_gso()
+{
+  /* fails on kernels without UDP GSO; a zero size leaves ordinary sends alone */
+  setsockopt( SOL_UDP, UDP_SEGMENT, int( 0 ) );
+  gso_enabled_ = true;
+}
+
+/* receive runs of datagrams coalesced by UDP generic receive offload (UDP_GRO) */
+void UDPSocket::set_gro()
+{
+  setsockopt( SOL_UDP, UDP_GRO, int( true ) );
+}
@@ -1,10 +1,19 @@
 #ifndef SOCKET_HH
 #define SOCKET_HH
 
+#include <deque>
 #include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "address.hh"
 #include "file_descriptor.hh"
+#include "poller.hh"
 
 /* class for network sockets (UDP, TCP, etc.) */
 class Socket : public FileDescriptor
@@ -14,6 +23,20 @@ private:
   Address get_address( const std::string & name_of_function,
 		       const std::function<int(int, sockaddr *, socklen_t *)> & function ) const;
 
+  /* control data space for an error queue message */
+  const static size_t ERROR_CONTROL_SIZE = 512;
+
+  /* MSG_ZEROCOPY sends (see set_zerocopy) */
+  bool zerocopy_;
+  uint32_t zerocopy_next_id_; /* id the kernel will give the next zerocopy send */
+  uint32_t zerocopy_completed_; /* every send before this id has completed */
+  std::deque<bool> zerocopy_done_; /* which sends from zerocopy_completed_ on have completed */
+  std::deque<std::pair<uint32_t, std::string>> zerocopy_pinned_; /* buffers, with the last send to use each */
+  uint64_t zerocopy_copies_;
+
+  /* the kernel finished with zerocopy sends first_id through last_id */
+  void zerocopy_complete( const uint32_t first_id, const uint32_t last_id );
+
 protected:
   /* default constructor */
   Socket( const int domain, const int type );
@@ -25,6 +48,28 @@ protected:
   template <typename option_type>
   void setsockopt( const int level, const int option, const option_type & option_value );
 
+  /* send with MSG_ZEROCOPY? */
+  bool zerocopy() const { return zerocopy_; }
+
+  /* smallest buffer worth sending with MSG_ZEROCOPY (anything smaller
+     is cheaper to copy, and may be stored inside the std::string itself,
+     so it would move when pinned) */
+  static const size_t ZEROCOPY_MIN_SIZE = 10240;
+
+  /* the id the kernel will give the next send with MSG_ZEROCOPY */
+  uint32_t zerocopy_next_id() const { return zerocopy_next_id_; }
+
+  /* a send with MSG_ZEROCOPY took some bytes; returns the id it was given */
+  uint32_t zerocopy_sent() { return zerocopy_next_id_++; }
+
+  /* keep buffer alive until send last_id (and every send before it)
+     completes; returns the pinned buffer, which stays where it is */
+  const std::string & pin( std::string && buffer, const uint32_t last_id );
+
+  /* drain the error queue without blocking, handling zerocopy completions
+     and passing any other message (e.g. a transmit timestamp) to other */
+  void recv_error_queue( const std::function<void( msghdr & )> & other );
+
 public:
   /* bind socket to a specified local address (usually to listen/accept) */
   void bind( const Address & address );
@@ -38,48 +83,240 @@ public:
 
   /* allow local address to be reused sooner, at the cost of some robustness */
   void set_reuseaddr();
+
+  /* let several sockets bind the same port, with the kernel spreading flows across them */
+  void set_reuseport();
+
+  /* Turn on SO_ZEROCOPY, so large sends (UDPSocket::send() of an rvalue
+     string, TCPSocket::flush()) pass MSG_ZEROCOPY: the kernel sends from
+     our buffer instead of copying it, and the socket keeps the buffer
+     pinned until the kernel reports (on the error queue) that it is done.
+     Drain the reports with recv_zerocopy_completions(), e.g. from the
+     action add_zerocopy_action() adds. Sends under ZEROCOPY_MIN_SIZE
+     are copied as usual. */
+  void set_zerocopy();
+
+  /* release the buffers of completed zerocopy sends (without blocking);
+     returns how many were released */
+  size_t recv_zerocopy_completions();
+
+  /* add an Error action that calls recv_zerocopy_completions() while
+     any buffer is pinned */
+  void add_zerocopy_action( Poller & poller );
+
+  size_t pinned_buffers() const { return zerocopy_pinned_.size(); }
+
+  /* completed zerocopy sends the kernel copied after all (e.g. over loopback) */
+  uint64_t zerocopy_copies() const { return zerocopy_copies_; }
 };
 
 /* UDP socket */
 class UDPSocket : public Socket
 {
 public:
-  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ) {}
-
   struct received_datagram {
     Address source_address;
     uint64_t timestamp;
+    uint64_t timestamp_ns;
     std::string payload;
   };
 
+  /* received datagram whose payload points into a ReceiveBuffer */
+  struct datagram_view {
+    Address source_address;
+    uint64_t timestamp;
+    uint64_t timestamp_ns;
+    const char * payload;
+    size_t payload_length;
+  };
+
+  /* caller-owned storage, reused across receives so they don't allocate */
+  class ReceiveBuffer
+  {
+  private:
+    friend class UDPSocket;
+
+    std::vector<char> storage_;
+    std::vector<Address::raw> source_addresses_;
+    std::vector<iovec> iovecs_;
+    std::vector<mmsghdr> headers_;
+    std::vector<datagram_view> datagrams_;
+
+  public:
+    /* room for up to max_datagrams messages per receive */
+    ReceiveBuffer( const size_t max_datagrams );
+
+    size_t capacity() const { return headers_.size(); }
+
+    /* datagrams from the most recent receive (valid until the next one) */
+    size_t size() const { return datagrams_.size(); }
+    const datagram_view & operator[]( const size_t i ) const { return datagrams_.at( i ); }
+    std::vector<datagram_view>::const_iterator begin() const { return datagrams_.begin(); }
+    std::vector<datagram_view>::const_iterator end() const { return datagrams_.end(); }
+
+    /* forbid copying (the headers point into our own storage) */
+    ReceiveBuffer( const ReceiveBuffer & other ) = delete;
+    const ReceiveBuffer & operator=( const ReceiveBuffer & other ) = delete;
+  };
+
+private:
+  /* largest datagram we can receive */
+  const static size_t RECEIVE_MTU = 65536;
+
+  /* control data space per datagram */
+  const static size_t CONTROL_SIZE = 1024;
+
+  /* most datagrams the kernel will split one GSO buffer into */
+  const static size_t GSO_MAX_SEGMENTS = 64;
+
+  /* largest GSO buffer (the UDP length limit applies before segmentation) */
+  const static size_t GSO_MAX_BYTES = 65507;
+
+  /* id the kernel will give the next datagram sent (see set_timestamping) */
+  uint32_t tx_id_;
+
+  /* storage for recv() and recv_batch( max_datagrams ) */
+  std::unique_ptr<ReceiveBuffer> recv_buffer_;
+
+  /* next datagram in recv_buffer_ not yet returned by recv() */
+  size_t recv_buffer_next_;
+
+  /* hand runs of equal-sized datagrams to the kernel as one buffer? */
+  bool gso_enabled_;
+
+  /* fill buffer with up to max_datagrams messages using one recvmmsg(),
+     splitting GRO-coalesced messages; returns the number of datagrams */
+  size_t recv_into( ReceiveBuffer & buffer, const size_t max_datagrams, const int flags );
+
+  /* copy the most recently received datagrams out of recv_buffer_ */
+  received_datagram copy_datagram( const size_t i ) const;
+
+public:
+  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ), tx_id_( 0 ), recv_buffer_(),
+		recv_buffer_next_( 0 ), gso_enabled_( false ) {}
+
+  /* when a sent datagram left (see set_timestamping) */
+  struct tx_timestamp {
+    uint32_t id; /* counts datagrams (or GSO buffers) sent on this socket */
+    uint64_t timestamp_ns;
+  };
+
   /* receive datagram, timestamp, and where it came from */
   received_datagram recv();
 
+  /* receive between one and max_datagrams datagrams with a single syscall */
+  std::vector<received_datagram> recv_batch( const size_t max_datagrams );
+
+  /* receive between one and buffer.capacity() messages into buffer,
+     without allocating or copying; returns the number of datagrams
+     (more than the number of messages if GRO coalesced some) */
+  size_t recv_batch( ReceiveBuffer & buffer );
+
+  /* same, but without blocking: returns zero once nothing is queued
+     (for edge-triggered loops that must read until EAGAIN) */
+  size_t try_recv_batch( ReceiveBuffer & buffer );
+
   /* send datagram to specified address */
   void sendto( const Address & peer, const std::string & payload );
 
   /* send datagram to connected address */
   void send( const std::string & payload );
 
+  /* same, and with zerocopy on (see set_zerocopy), hand the kernel the payload itself */
+  void send( std::string && payload );
+
+  /* send several datagrams to connected address with as few syscalls as possible;
+     returns the tx_timestamp id of each one */
+  std::vector<uint32_t> send_batch( const std::vector<std::string> & payloads )
+  { return send_batch( payloads.data(), payloads.size() ); }
+
+  /* same, for the first count of a pool of reused packet buffers */
+  std::vector<uint32_t> send_batch( const std::string * payloads, const size_t count );
+
+  /* tx_timestamp id of the next datagram sent with send() or sendto() */
+  uint32_t next_tx_id() const { return tx_id_; }
+
   /* turn on timestamps on receipt */
   void set_timestamps();
+
+  /* turn on SO_TIMESTAMPING: nanosecond software timestamps on receipt, and (if transmit) transmit timestamps on the error
+     queue, which the caller must then drain with recv_tx_timestamps() */
+  void set_timestamping( const bool transmit = true );
+
+  /* collect the transmit timestamps waiting on the error queue (without
+     blocking), handling any zerocopy completions queued with them */
+  std::vector<tx_timestamp> recv_tx_timestamps();
+
+  /* turn a received message into datagrams (splitting it if GRO coalesced
+     several), for receive paths that don't go through recv_batch() */
+  static void parse_message( msghdr & header,
+			     const Address & source_address,
+			     const char * payload,
+			     const size_t length,
+			     std::vector<datagram_view> & datagrams );
+
+  /* let send_batch() use UDP generic segmentation offload (UDP_SEGMENT) */
+  void set_gso();
+
+  /* receive runs of datagrams coalesced by UDP generic receive offload (UDP_GRO) */
+  void set_gro();
 };
 
 /* TCP socket */
 class TCPSocket : public Socket
 {
 private:
+  /* most buffers handed to the kernel by one flush() syscall */
+  const static size_t MAX_FLUSH_BUFFERS = 64;
+
+  /* outbound data not yet taken by the kernel, oldest first */
+  std::deque<std::string> output_;
+
+  /* bytes of output_.front() already written */
+  size_t output_offset_;
+
+  /* bytes in output_, less output_offset_ */
+  size_t queued_bytes_;
+
   /* private constructor used by accept() */
-  TCPSocket( FileDescriptor && fd ) : Socket( std::move( fd ), AF_INET6, SOCK_STREAM ) {}
+  TCPSocket( FileDescriptor && fd ) : Socket( std::move( fd ), AF_INET6, SOCK_STREAM ),
+				      output_(), output_offset_( 0 ), queued_bytes_( 0 ) {}
 
 public:
-  TCPSocket() : Socket( AF_INET6, SOCK_STREAM ) {}
+  TCPSocket() : Socket( AF_INET6, SOCK_STREAM ), output_(), output_offset_( 0 ), queued_bytes_( 0 ) {}
 
   /* mark the socket as listening for incoming connections */
   void listen( const int backlog = 16 );
 
   /* accept a new incoming connection */
   TCPSocket accept();
+
+  /* accept every connection waiting on a nonblocking listening socket,
+     without blocking; the new sockets are nonblocking too */
+  std::vector<TCPSocket> accept_pending();
+
+  /* Buffered output, for nonblocking sockets (see set_blocking()):
+     queue_write() only queues, and flush() hands the kernel as much of
+     the queue as it will take without blocking, several buffers per
+     syscall, so a run of small writes goes out together and a slow
+     peer leaves data queued rather than stalling the caller. Call
+     flush() when the poller says the socket is writable (e.g. from an
+     Out action interested while queued_bytes() is nonzero). */
+  void queue_write( std::string && data );
+  void queue_write( const std::string & data ) { queue_write( std::string( data ) ); }
+
+  /* write queued data until the kernel would block; returns true once the queue is empty */
+  bool flush();
+
+  size_t queued_bytes() const { return queued_bytes_; }
+
+  /* send up to length bytes of file, starting at offset, with sendfile()
+     (the kernel copies from the page cache, never through user space),
+     once anything queued has been flushed; returns how many bytes of the
+     file were sent, zero if the socket would block or the file ended.
+     Stream a large file from an Out action that advances offset by
+     the return value and is interested until length bytes are sent. */
+  size_t send_file( FileDescriptor & file, const off_t offset, const size_t length );
 };
 
 #endif /* SOCKET_HH */
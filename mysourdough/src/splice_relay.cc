@@ -0,0 +1,89 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "splice_relay.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* make a nonblocking pipe, returning its read and write ends */
+static pair<int, int> make_pipe()
+{
+  int fds[ 2 ];
+  SystemCall( "pipe2", pipe2( fds, O_NONBLOCK | O_CLOEXEC ) );
+  return make_pair( fds[ 0 ], fds[ 1 ] );
+}
+
+SpliceRelay::SpliceRelay( FileDescriptor & source, FileDescriptor & destination )
+  : SpliceRelay( source, destination, make_pipe() )
+{}
+
+SpliceRelay::SpliceRelay( FileDescriptor & source, FileDescriptor & destination,
+			  const pair<int, int> & pipe_fds )
+  : source_( source ),
+    destination_( destination ),
+    pipe_out_( pipe_fds.first ),
+    pipe_in_( pipe_fds.second ),
+    capacity_( SystemCall( "fcntl", fcntl( pipe_in_.fd_num(), F_GETPIPE_SZ ) ) ),
+    buffered_( 0 ),
+    pipe_full_( false )
+{}
+
+/* move bytes from the source into the pipe */
+size_t SpliceRelay::fill()
+{
+  size_t total = 0;
+
+  while ( buffered_ < capacity_ and not source_.eof() ) {
+    const size_t moved = source_.splice_to( pipe_in_, capacity_ - buffered_ );
+    if ( moved == 0 ) {
+      /* with bytes in the pipe, assume it's the pipe that refused
+	 (if it was the source, the next drain clears this anyway) */
+      pipe_full_ = buffered_ > 0 and not source_.eof();
+      break;
+    }
+
+    buffered_ += moved;
+    total += moved;
+  }
+
+  return total;
+}
+
+/* move bytes from the pipe to the destination */
+size_t SpliceRelay::drain()
+{
+  size_t total = 0;
+
+  while ( buffered_ > 0 ) {
+    const size_t moved = pipe_out_.splice_to( destination_, buffered_ );
+    if ( moved == 0 ) {
+      break;
+    }
+
+    buffered_ -= moved;
+    total += moved;
+    pipe_full_ = false;
+  }
+
+  return total;
+}
+
+/* add the actions that keep the relay moving */
+void SpliceRelay::add_actions( Poller & poller )
+{
+  poller.add_action( Action( source_, Direction::In,
+			     [&] () {
+			       fill();
+			       return ResultType::Continue;
+			     },
+			     [&] () { return buffered_ < capacity_ and not pipe_full_; } ) );
+
+  poller.add_action( Action( destination_, Direction::Out,
+			     [&] () {
+			       drain();
+			       return ResultType::Continue;
+			     },
+			     [&] () { return buffered_ > 0; } ) );
+}
@@ -0,0 +1,59 @@
+#ifndef SPLICE_RELAY_HH
+#define SPLICE_RELAY_HH
+
+#include <utility>
+
+#include "file_descriptor.hh"
+#include "poller.hh"
+
+/* Relay bytes from one fd to another (e.g. socket to socket, or file to
+   socket) through a kernel pipe with splice(), so they never enter user
+   space. The pipe is the relay's buffer: the source fills it as long as
+   there is room, and the destination drains it as it becomes writable.
+   Sockets should be nonblocking (see set_blocking()) so that neither
+   side can hold up the loop. */
+class SpliceRelay
+{
+private:
+  FileDescriptor & source_;
+  FileDescriptor & destination_;
+
+  /* the two ends of the pipe */
+  FileDescriptor pipe_out_, pipe_in_;
+
+  size_t capacity_; /* bytes the pipe can hold */
+  size_t buffered_; /* bytes in the pipe */
+
+  /* the pipe took nothing more, short of capacity_ (each splice takes a
+     slot of the pipe's ring, however few bytes it moves), until the
+     next drain */
+  bool pipe_full_;
+
+  /* constructor given the read and write ends of a new pipe */
+  SpliceRelay( FileDescriptor & source, FileDescriptor & destination,
+	       const std::pair<int, int> & pipe_fds );
+
+public:
+  SpliceRelay( FileDescriptor & source, FileDescriptor & destination );
+
+  /* move bytes from the source into the pipe until it is full or the
+     source would block; returns how many */
+  size_t fill();
+
+  /* move bytes from the pipe to the destination until it is empty or the
+     destination would block; returns how many */
+  size_t drain();
+
+  size_t buffered() const { return buffered_; }
+
+  /* has everything the source will ever send been delivered? */
+  bool done() const { return source_.eof() and buffered_ == 0; }
+
+  /* add the actions that keep the relay moving: read the source while
+     the pipe has room, write the destination while the pipe has data
+     (so, as with any other action, an fd that reports ready but moves
+     nothing ends the loop as a busy wait) */
+  void add_actions( Poller & poller );
+};
+
+#endif /* SPLICE_RELAY_HH */
@@ -0,0 +1,188 @@
+#include <cstdlib>
+#include <thread>
+
+#include "tcp_server.hh"
+#include "edge_poller.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+TCPServer::Connection::Connection( TCPSocket && socket, const size_t buffer_size )
+  : socket_( move( socket ) ),
+    peer_( socket_.peer_address().to_string() ),
+    input_( buffer_size )
+{}
+
+TCPServer::TCPServer( const Address & address,
+		      const unsigned int workers,
+		      const Handler & on_data,
+		      const Handler & on_connect,
+		      const Handler & on_close,
+		      const size_t buffer_size )
+  : buffer_size_( buffer_size ),
+    on_data_( on_data ),
+    on_connect_( on_connect ),
+    on_close_( on_close ),
+    listeners_()
+{
+  if ( workers == 0 ) {
+    throw runtime_error( "TCPServer needs at least one worker" );
+  }
+
+  for ( unsigned int i = 0; i < workers; i++ ) {
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.set_reuseport();
+
+    /* if the port was 0, the other workers join whichever one the first got */
+    listener.bind( listeners_.empty() ? address : local_address() );
+    listener.listen( SOMAXCONN );
+    listener.set_blocking( false );
+
+    listeners_.push_back( move( listener ) );
+  }
+}
+
+/* start the workers and serve clients forever */
+void TCPServer::run()
+{
+  /* a worker can't carry on alone (and the calling thread, the first
+     worker, mustn't unwind past the others' still-running threads) */
+  const auto serve_or_exit = [this] ( TCPSocket & listener ) {
+    try {
+      serve( listener );
+    } catch ( const exception & e ) {
+      print_exception( e );
+      exit( EXIT_FAILURE );
+    }
+  };
+
+  vector<thread> workers;
+
+  for ( unsigned int i = 1; i < listeners_.size(); i++ ) {
+    workers.emplace_back( [this, i, &serve_or_exit] () { serve_or_exit( listeners_.at( i ) ); } );
+  }
+
+  /* the calling thread is the first worker */
+  serve_or_exit( listeners_.front() );
+
+  for ( auto & worker : workers ) {
+    worker.join();
+  }
+}
+
+/* one worker's event loop */
+void TCPServer::serve( TCPSocket & listener ) const
+{
+  /* token 0 is the listener; connection i has token i + 1 */
+  const uint32_t LISTENER = 0;
+
+  EdgePoller poller;
+  poller.add( listener, EPOLLIN, LISTENER );
+
+  vector<unique_ptr<Connection>> connections;
+  vector<uint32_t> free_slots;
+
+  const auto close_connection = [&] ( const uint32_t slot ) {
+    Connection & connection = *connections.at( slot );
+
+    try {
+      on_close_( connection );
+    } catch ( const exception & e ) {
+      print_exception( e );
+    }
+
+    poller.remove( connection.socket() );
+    connections.at( slot ).reset();
+    free_slots.push_back( slot );
+  };
+
+  /* read until EAGAIN (the poller is edge-triggered); returns false at EOF */
+  const auto read_all = [&] ( Connection & connection ) {
+    while ( true ) {
+      if ( connection.input().free_space() == 0 ) {
+	throw runtime_error( "input from " + connection.peer() + " overflowed its buffer" );
+      }
+
+      const buffer_view chunk = connection.socket().read_into( connection.input() );
+      if ( connection.socket().eof() ) {
+	return false;
+      } else if ( chunk.size() == 0 ) {
+	return true;
+      }
+
+      on_data_( connection );
+    }
+  };
+
+  const auto handler = [&] ( const uint32_t token, const uint32_t events ) -> Result {
+    if ( token == LISTENER ) {
+      for ( auto & socket : listener.accept_pending() ) {
+	uint32_t slot;
+	if ( free_slots.empty() ) {
+	  slot = connections.size();
+	  connections.emplace_back();
+	} else {
+	  slot = free_slots.back();
+	  free_slots.pop_back();
+	}
+
+	try {
+	  connections.at( slot ).reset( new Connection( move( socket ), buffer_size_ ) );
+	} catch ( const exception & e ) { /* e.g. the client already reset it */
+	  print_exception( e );
+	  free_slots.push_back( slot );
+	  continue;
+	}
+
+	Connection & connection = *connections.at( slot );
+	poller.add( connection.socket(), EPOLLIN | EPOLLOUT | EPOLLRDHUP, slot + 1 );
+
+	try {
+	  on_connect_( connection );
+	  connection.socket().flush();
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  close_connection( slot );
+	}
+      }
+
+      return ResultType::Continue;
+    }
+
+    /* the connection may already have been closed earlier in this batch */
+    const uint32_t slot = token - 1;
+    if ( not connections.at( slot ) ) {
+      return ResultType::Continue;
+    }
+
+    /* errors and hangups surface as a failed or empty read; whatever
+       the handlers queued goes out now, or when the socket next becomes
+       writable (EPOLLOUT) if the client is slow to take it */
+    Connection & connection = *connections.at( slot );
+    bool open = true;
+    try {
+      if ( events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ) {
+	open = read_all( connection );
+      }
+
+      if ( open and connection.socket().queued_bytes() > 0 ) {
+	connection.socket().flush();
+      }
+    } catch ( const exception & e ) { /* one client's problem, not the server's */
+      print_exception( e );
+      open = false;
+    }
+
+    if ( not open ) {
+      close_connection( slot );
+    }
+
+    return ResultType::Continue;
+  };
+
+  while ( true ) {
+    poller.poll( -1, handler );
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef TCP_SERVER_HH
+#define TCP_SERVER_HH
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "address.hh"
+#include "ring_buffer.hh"
+#include "socket.hh"
+
+/* Event-driven TCP server on a fixed pool of worker threads.
+
+   Each worker has its own listening socket, bound to the same address
+   with SO_REUSEPORT so the kernel spreads new connections across them,
+   and its own edge-triggered epoll loop (EdgePoller) over the
+   nonblocking connections it accepted. A connection costs a socket and
+   an input buffer, not a thread and a stack, and a connection stays on
+   the worker that accepted it, so handlers never race on it. */
+class TCPServer
+{
+public:
+  /* one client, owned by the worker that accepted it */
+  class Connection
+  {
+  private:
+    TCPSocket socket_;
+    std::string peer_; /* looked up once, when the connection is accepted */
+    RingBuffer input_;
+
+  public:
+    Connection( TCPSocket && socket, const size_t buffer_size );
+
+    TCPSocket & socket() { return socket_; }
+    const std::string & peer() const { return peer_; }
+
+    /* bytes received and not yet consumed by the data handler */
+    RingBuffer & input() { return input_; }
+  };
+
+  typedef std::function<void( Connection & )> Handler;
+
+private:
+  /* how much of each client's input can wait to be consumed */
+  size_t buffer_size_;
+
+  Handler on_data_, on_connect_, on_close_;
+
+  /* one per worker */
+  std::vector<TCPSocket> listeners_;
+
+  /* one worker's event loop (never returns) */
+  void serve( TCPSocket & listener ) const;
+
+public:
+  /* bind the workers' listening sockets to address; on_data is called (on
+     the connection's worker) after every read that brought in new
+     bytes, and consumes as much of connection.input() as it can use.
+     Handlers reply with connection.socket().queue_write(), which the
+     worker flushes as the client takes the data. */
+  TCPServer( const Address & address,
+	     const unsigned int workers,
+	     const Handler & on_data,
+	     const Handler & on_connect = [] ( Connection & ) {},
+	     const Handler & on_close = [] ( Connection & ) {},
+	     const size_t buffer_size = 16384 );
+
+  /* where the server is listening (useful after binding port 0) */
+  Address local_address() const { return listeners_.front().local_address(); }
+
+  /* start the workers and serve clients forever */
+  void run();
+};
+
+#endif /* TCP_SERVER_HH */
@@ -0,0 +1,74 @@
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "timer.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* nanoseconds per second */
+static const uint64_t BILLION = 1000000000;
+
+static timespec to_timespec( const uint64_t ns )
+{
+  timespec ret;
+  ret.tv_sec = ns / BILLION;
+  ret.tv_nsec = ns % BILLION;
+  return ret;
+}
+
+Timer::Timer()
+  : FileDescriptor( SystemCall( "timerfd_create",
+				timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) ),
+    armed_( false ),
+    recurring_( false )
+{}
+
+/* expire after delay_ns, then every interval_ns (if nonzero) */
+void Timer::arm( const uint64_t delay_ns, const uint64_t interval_ns )
+{
+  itimerspec setting;
+  setting.it_interval = to_timespec( interval_ns );
+
+  /* an all-zero it_value would disarm the timer instead */
+  setting.it_value = to_timespec( delay_ns ? delay_ns : 1 );
+
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), 0, &setting, nullptr ) );
+  armed_ = true;
+  recurring_ = interval_ns;
+}
+
+/* cancel any pending expiration */
+void Timer::disarm()
+{
+  itimerspec setting;
+  zero( setting );
+
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), 0, &setting, nullptr ) );
+  armed_ = false;
+}
+
+/* how many times the timer has expired since the last call (without blocking) */
+uint64_t Timer::read_expirations()
+{
+  uint64_t expirations = 0;
+
+  if ( ::read( fd_num(), &expirations, sizeof( expirations ) ) < 0 ) {
+    if ( errno != EAGAIN ) {
+      throw unix_error( "read (timerfd)" );
+    }
+
+    /* re-armed (or disarmed) since it became readable */
+    expirations = 0;
+  }
+
+  /* counts as servicing the fd either way, for Poller's busy-wait check */
+  register_read();
+
+  /* a one-shot timer is done once it has expired */
+  if ( expirations and not recurring_ ) {
+    armed_ = false;
+  }
+
+  return expirations;
+}
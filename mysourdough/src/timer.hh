@@ -0,0 +1,32 @@
+#ifndef TIMER_HH
+#define TIMER_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* a timerfd on CLOCK_MONOTONIC: readable once it has expired
+   (see Poller::add_timer_action) */
+class Timer : public FileDescriptor
+{
+private:
+  bool armed_;
+  bool recurring_;
+
+public:
+  Timer();
+
+  /* expire after delay_ns, then every interval_ns (if nonzero) */
+  void arm( const uint64_t delay_ns, const uint64_t interval_ns = 0 );
+
+  /* cancel any pending expiration */
+  void disarm();
+
+  /* is an expiration pending (or recurring)? */
+  bool armed() const { return armed_; }
+
+  /* how many times the timer has expired since the last call (without blocking) */
+  uint64_t read_expirations();
+};
+
+#endif /* TIMER_HH */
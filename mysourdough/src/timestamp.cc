@@ -1,36 +1,76 @@
 #include <ctime>
 
 #include "timestamp.hh"
-#include "util.hh"
+
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND = 1000;
 
 /* nanoseconds per millisecond */
-static const uint64_t MILLION = 1000000;
+static const uint64_t MILLION = 1000 * THOUSAND;
 
 /* nanoseconds per second */
 static const uint64_t BILLION = 1000 * MILLION;
 
 /* helper functions */
-static timespec current_time()
+static uint64_t timestamp_ns_raw( const timespec & ts )
+{
+  return ts.tv_sec * BILLION + ts.tv_nsec;
+}
+
+/* clock_gettime() only fails for a bad clock or pointer, so don't check */
+static uint64_t clock_ns( const clockid_t clock ) noexcept
 {
   timespec ret;
-  SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ret ) );
-  return ret;
+  clock_gettime( clock, &ret );
+  return timestamp_ns_raw( ret );
+}
+
+/* the start of the program (read once) */
+static uint64_t start_ns() noexcept
+{
+  const static uint64_t START = clock_ns( CLOCK_MONOTONIC );
+  return START;
+}
+
+/* read the clock as the program starts */
+static const uint64_t PROGRAM_START = start_ns();
+
+/* Current time in nanoseconds since the start of the program */
+uint64_t timestamp_ns() noexcept
+{
+  const uint64_t start = start_ns();
+  return clock_ns( CLOCK_MONOTONIC ) - start;
 }
 
-static uint64_t timestamp_ms_raw( const timespec & ts )
+/* Current time in microseconds since the start of the program */
+uint64_t timestamp_us() noexcept
 {
-  const uint64_t nanos = ts.tv_sec * BILLION + ts.tv_nsec;
-  return nanos / MILLION;
+  return timestamp_ns() / THOUSAND;
 }
 
 /* Current time in milliseconds since the start of the program */
-uint64_t timestamp_ms()
+uint64_t timestamp_ms() noexcept
+{
+  return timestamp_ns() / MILLION;
+}
+
+/* A kernel timestamp moved onto the same scale: the stamp's age on the
+   wall clock, taken back from the monotonic clock now (reading both
+   clocks each time, so a step of the wall clock since the program
+   started doesn't shift every later time, and a stamp that seems to be
+   from the future, or from before the start, is clamped instead) */
+uint64_t timestamp_ns( const timespec & ts )
 {
-  return timestamp_ms( current_time() );
+  const uint64_t realtime_now = clock_ns( CLOCK_REALTIME );
+  const uint64_t monotonic_now = timestamp_ns();
+
+  const uint64_t raw = timestamp_ns_raw( ts );
+  const uint64_t age = raw < realtime_now ? realtime_now - raw : 0;
+
+  return age < monotonic_now ? monotonic_now - age : 0;
 }
 
 uint64_t timestamp_ms( const timespec & ts )
 {
-  const static uint64_t EPOCH = timestamp_ms_raw( current_time() );
-  return timestamp_ms_raw( ts ) - EPOCH;
+  return timestamp_ns( ts ) / MILLION;
 }
@@ -4,8 +4,18 @@
 #include <ctime>
 #include <cstdint>
 
-/* Current time in milliseconds since the start of the program */
-uint64_t timestamp_ms();
+/* Current time since the start of the program, from CLOCK_MONOTONIC
+   (so wall-clock adjustments can't corrupt RTT samples). These read the
+   clock directly (through the vDSO) and can't fail, so they skip the
+   throwing SystemCall wrapper. */
+uint64_t timestamp_ns() noexcept;
+uint64_t timestamp_us() noexcept;
+uint64_t timestamp_ms() noexcept;
+
+/* A recent kernel timestamp (CLOCK_REALTIME, e.g. from SO_TIMESTAMPNS)
+   moved onto the same scale as the above (by its age, so wall-clock
+   steps only disturb stamps taken just before them) */
+uint64_t timestamp_ns( const timespec & ts );
 uint64_t timestamp_ms( const timespec & ts );
 
 #endif /* TIMESTAMP_HH */
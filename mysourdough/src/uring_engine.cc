@@ -0,0 +1,469 @@
+#include <csignal>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring_engine.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* what a completion's user_data refers to (kind in the high bits, index below) */
+enum class Completion : uint64_t { Receive = 1, Send = 2, Cancel = 3 };
+
+static uint64_t user_data( const Completion kind, const size_t index )
+{
+  return (uint64_t( kind ) << 32) | index;
+}
+
+/* buffer group id of our provided-buffer ring */
+static const uint16_t BUFFER_GROUP = 0;
+
+/* raw io_uring syscalls (no liburing dependency) */
+static int io_uring_setup( const unsigned int entries, io_uring_params * params )
+{
+  return syscall( __NR_io_uring_setup, entries, params );
+}
+
+static int io_uring_enter( const int fd, const unsigned int to_submit,
+			   const unsigned int min_complete, const unsigned int flags,
+			   const void * arg, const size_t arg_size )
+{
+  return syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size );
+}
+
+static int io_uring_register( const int fd, const unsigned int opcode,
+			      const void * arg, const unsigned int nr_args )
+{
+  return syscall( __NR_io_uring_register, fd, opcode, arg, nr_args );
+}
+
+/* ask for a completion ring big enough to hold a burst of send completions */
+static io_uring_params ring_params( const unsigned int entries )
+{
+  io_uring_params params;
+  zero( params );
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = 4 * entries;
+  return params;
+}
+
+/* map part of the ring into our address space */
+static void * map_ring( const int fd, const size_t size, const off_t offset )
+{
+  void * const ret = mmap( nullptr, size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, offset );
+  if ( ret == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+  return ret;
+}
+
+template <typename T>
+static T * ring_field( void * base, const uint32_t offset )
+{
+  return reinterpret_cast<T *>( static_cast<char *>( base ) + offset );
+}
+
+URingEngine::ReceiveAction::ReceiveAction( UDPSocket & s_socket,
+					   const ReceiveCallback & s_callback )
+  : socket( s_socket ), callback( s_callback ), header(), armed( false ), active( true )
+{
+  zero( header );
+  header.msg_namelen = sizeof( Address::raw );
+  header.msg_controllen = 1024;
+}
+
+URingEngine::PendingSend::PendingSend()
+  : payload(), destination(), payload_iovec(), header()
+{}
+
+URingEngine::URingEngine( const unsigned int entries )
+  : params_( ring_params( entries ) ),
+    ring_fd_( SystemCall( "io_uring_setup", io_uring_setup( entries, &params_ ) ) ),
+    rings_( nullptr ),
+    rings_size_( 0 ),
+    sqes_( nullptr ),
+    sq_head_( nullptr ), sq_tail_( nullptr ), sq_mask_( nullptr ), sq_array_( nullptr ),
+    cq_head_( nullptr ), cq_tail_( nullptr ), cq_mask_( nullptr ),
+    cqes_( nullptr ),
+    sq_local_tail_( 0 ),
+    to_submit_( 0 ),
+    buf_ring_( nullptr ),
+    buffers_( BUFFER_SIZE * BUFFER_COUNT ),
+    receive_actions_(),
+    sends_(),
+    free_sends_(),
+    sends_in_flight_( 0 ),
+    datagrams_()
+{
+  if ( not (params_.features & IORING_FEAT_SINGLE_MMAP)
+       or not (params_.features & IORING_FEAT_EXT_ARG) ) {
+    throw runtime_error( "URingEngine: kernel io_uring is too old" );
+  }
+
+  /* one mapping holds both the submission and the completion ring */
+  rings_size_ = max( params_.sq_off.array + params_.sq_entries * sizeof( unsigned int ),
+		     params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ) );
+  rings_ = map_ring( ring_fd_.fd_num(), rings_size_, IORING_OFF_SQ_RING );
+  sqes_ = static_cast<io_uring_sqe *>( map_ring( ring_fd_.fd_num(),
+						 params_.sq_entries * sizeof( io_uring_sqe ),
+						 IORING_OFF_SQES ) );
+
+  sq_head_ = ring_field<unsigned int>( rings_, params_.sq_off.head );
+  sq_tail_ = ring_field<unsigned int>( rings_, params_.sq_off.tail );
+  sq_mask_ = ring_field<unsigned int>( rings_, params_.sq_off.ring_mask );
+  sq_array_ = ring_field<unsigned int>( rings_, params_.sq_off.array );
+  cq_head_ = ring_field<unsigned int>( rings_, params_.cq_off.head );
+  cq_tail_ = ring_field<unsigned int>( rings_, params_.cq_off.tail );
+  cq_mask_ = ring_field<unsigned int>( rings_, params_.cq_off.ring_mask );
+  cqes_ = ring_field<io_uring_cqe>( rings_, params_.cq_off.cqes );
+  sq_local_tail_ = *sq_tail_;
+
+  /* register the buffers the multishot receives will fill */
+  buf_ring_ = static_cast<io_uring_buf_ring *>( mmap( nullptr, BUFFER_COUNT * sizeof( io_uring_buf ),
+						      PROT_READ | PROT_WRITE,
+						      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) );
+  if ( buf_ring_ == MAP_FAILED ) {
+    buf_ring_ = nullptr;
+    throw unix_error( "mmap" );
+  }
+
+  io_uring_buf_reg registration;
+  zero( registration );
+  registration.ring_addr = reinterpret_cast<uint64_t>( buf_ring_ );
+  registration.ring_entries = BUFFER_COUNT;
+  registration.bgid = BUFFER_GROUP;
+  SystemCall( "io_uring_register", io_uring_register( ring_fd_.fd_num(),
+						      IORING_REGISTER_PBUF_RING,
+						      &registration, 1 ) );
+
+  for ( unsigned int i = 0; i < BUFFER_COUNT; i++ ) {
+    recycle_buffer( i );
+  }
+
+  datagrams_.reserve( BUFFER_COUNT );
+}
+
+URingEngine::~URingEngine()
+{
+  /* closing the ring (in ring_fd_'s destructor) cancels outstanding work */
+  if ( buf_ring_ ) {
+    munmap( buf_ring_, BUFFER_COUNT * sizeof( io_uring_buf ) );
+  }
+  if ( sqes_ ) {
+    munmap( sqes_, params_.sq_entries * sizeof( io_uring_sqe ) );
+  }
+  if ( rings_ ) {
+    munmap( rings_, rings_size_ );
+  }
+}
+
+/* get a zeroed submission entry (flushing to the kernel if the ring is full) */
+io_uring_sqe & URingEngine::next_sqe()
+{
+  if ( sq_local_tail_ - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ) >= params_.sq_entries
+       and enter( 0, 0 ) < 0 ) {
+    throw unix_error( "io_uring_enter" );
+  }
+
+  const unsigned int index = sq_local_tail_ & *sq_mask_;
+  io_uring_sqe & sqe = sqes_[ index ];
+  zero( sqe );
+  sq_array_[ index ] = index;
+  sq_local_tail_++;
+  to_submit_++;
+
+  return sqe;
+}
+
+/* hand prepared entries to the kernel, optionally waiting for a completion */
+int URingEngine::enter( const unsigned int min_complete, const int timeout_ms )
+{
+  __atomic_store_n( sq_tail_, sq_local_tail_, __ATOMIC_RELEASE );
+
+  __kernel_timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+  io_uring_getevents_arg arg;
+  zero( arg );
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = timeout_ms < 0 ? 0 : reinterpret_cast<uint64_t>( &timeout );
+
+  const int ret = io_uring_enter( ring_fd_.fd_num(), to_submit_, min_complete,
+				  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+				  &arg, sizeof( arg ) );
+
+  if ( ret >= 0 ) {
+    to_submit_ -= min( to_submit_, unsigned( ret ) );
+  } else if ( errno != ETIME ) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/* keep a multishot receive armed on socket; callback runs once per datagram */
+void URingEngine::add_receive_action( UDPSocket & socket, const ReceiveCallback & callback )
+{
+  receive_actions_.emplace_back( new ReceiveAction( socket, callback ) );
+}
+
+void URingEngine::arm_receive( const size_t index )
+{
+  ReceiveAction & action = *receive_actions_.at( index );
+
+  io_uring_sqe & sqe = next_sqe();
+  sqe.opcode = IORING_OP_RECVMSG;
+  sqe.fd = action.socket.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( &action.header );
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = BUFFER_GROUP;
+  sqe.user_data = user_data( Completion::Receive, index );
+
+  action.armed = true;
+}
+
+/* give a receive buffer back to the kernel */
+void URingEngine::recycle_buffer( const unsigned int buffer_id )
+{
+  /* (index from the start of the ring ourselves: in C++ the header's
+     flexible-array wrapper puts bufs at the wrong offset) */
+  io_uring_buf * const bufs = reinterpret_cast<io_uring_buf *>( buf_ring_ );
+
+  const uint16_t tail = buf_ring_->tail;
+  io_uring_buf & buf = bufs[ tail & (BUFFER_COUNT - 1) ];
+  buf.addr = reinterpret_cast<uint64_t>( &buffers_[ buffer_id * BUFFER_SIZE ] );
+  buf.len = BUFFER_SIZE;
+  buf.bid = buffer_id;
+  __atomic_store_n( &buf_ring_->tail, uint16_t( tail + 1 ), __ATOMIC_RELEASE );
+}
+
+size_t URingEngine::free_send()
+{
+  if ( free_sends_.empty() ) {
+    free_sends_.push_back( sends_.size() );
+    sends_.emplace_back( new PendingSend );
+  }
+
+  const size_t index = free_sends_.back();
+  free_sends_.pop_back();
+  return index;
+}
+
+size_t URingEngine::new_send( string && payload )
+{
+  const size_t index = free_send();
+  sends_.at( index )->payload = move( payload );
+  prepare_send( index );
+  return index;
+}
+
+size_t URingEngine::new_send( const char * data, const size_t length )
+{
+  const size_t index = free_send();
+  sends_.at( index )->payload.assign( data, length );
+  prepare_send( index );
+  return index;
+}
+
+void URingEngine::prepare_send( const size_t index )
+{
+  PendingSend & pending = *sends_.at( index );
+  pending.payload_iovec.iov_base = const_cast<char *>( pending.payload.data() );
+  pending.payload_iovec.iov_len = pending.payload.size();
+  zero( pending.header );
+  pending.header.msg_iov = &pending.payload_iovec;
+  pending.header.msg_iovlen = 1;
+}
+
+void URingEngine::queue_send( const FileDescriptor & fd, const size_t index )
+{
+  io_uring_sqe & sqe = next_sqe();
+  sqe.opcode = IORING_OP_SENDMSG;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( &sends_.at( index )->header );
+  sqe.user_data = user_data( Completion::Send, index );
+  sends_in_flight_++;
+}
+
+/* queue a datagram to the socket's connected peer */
+void URingEngine::send( UDPSocket & socket, string && payload )
+{
+  queue_send( socket, new_send( move( payload ) ) );
+}
+
+/* same, copying the bytes into a recycled buffer */
+void URingEngine::send( UDPSocket & socket, const char * data, const size_t length )
+{
+  queue_send( socket, new_send( data, length ) );
+}
+
+/* queue a datagram to a specified address */
+void URingEngine::sendto( UDPSocket & socket, const Address & destination, string && payload )
+{
+  queue_sendto( socket, destination, new_send( move( payload ) ) );
+}
+
+void URingEngine::sendto( UDPSocket & socket, const Address & destination,
+			  const char * data, const size_t length )
+{
+  queue_sendto( socket, destination, new_send( data, length ) );
+}
+
+void URingEngine::queue_sendto( const FileDescriptor & fd, const Address & destination,
+				const size_t index )
+{
+  PendingSend & pending = *sends_.at( index );
+  memcpy( &pending.destination, &destination.to_sockaddr(), destination.size() );
+  pending.header.msg_name = &pending.destination;
+  pending.header.msg_namelen = destination.size();
+
+  queue_send( fd, index );
+}
+
+/* handle one completion; returns true (and fills in result) if the loop should exit */
+bool URingEngine::complete( const io_uring_cqe & cqe, Poller::Result & result )
+{
+  const Completion kind = Completion( cqe.user_data >> 32 );
+  const size_t index = cqe.user_data & 0xffffffff;
+
+  if ( kind == Completion::Send ) {
+    PendingSend & pending = *sends_.at( index );
+    sends_in_flight_--;
+    free_sends_.push_back( index );
+
+    if ( cqe.res < 0 ) {
+      throw unix_error( "io_uring sendmsg", -cqe.res );
+    } else if ( size_t( cqe.res ) != pending.payload.size() ) {
+      throw runtime_error( "datagram payload too big for io_uring sendmsg" );
+    }
+    return false;
+  } else if ( kind != Completion::Receive ) {
+    return false;
+  }
+
+  ReceiveAction & action = *receive_actions_.at( index );
+
+  /* the kernel disarms the receive when it runs out of buffers (or on error) */
+  if ( not (cqe.flags & IORING_CQE_F_MORE) ) {
+    action.armed = false;
+  }
+
+  if ( cqe.res < 0 ) {
+    if ( -cqe.res == ENOBUFS or -cqe.res == ECANCELED ) {
+      return false;
+    }
+    throw unix_error( "io_uring recvmsg", -cqe.res );
+  }
+
+  if ( not (cqe.flags & IORING_CQE_F_BUFFER) ) {
+    throw runtime_error( "io_uring recvmsg completed without a buffer" );
+  }
+
+  const unsigned int buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  char * const buffer = &buffers_[ buffer_id * BUFFER_SIZE ];
+
+  /* buffer layout: io_uring_recvmsg_out, then name, control and payload regions */
+  const io_uring_recvmsg_out * const out = reinterpret_cast<io_uring_recvmsg_out *>( buffer );
+  char * const name = buffer + sizeof( *out );
+  char * const control = name + action.header.msg_namelen;
+  const char * const payload = control + action.header.msg_controllen;
+
+  msghdr header;
+  zero( header );
+  header.msg_control = control;
+  header.msg_controllen = out->controllen;
+  header.msg_flags = out->flags;
+
+  Address::raw source;
+  const socklen_t source_size = min( out->namelen, action.header.msg_namelen );
+  memcpy( &source, name, source_size );
+
+  datagrams_.clear();
+  try {
+    UDPSocket::parse_message( header, Address( source, source_size ),
+			      payload, out->payloadlen, datagrams_ );
+  } catch ( ... ) {
+    recycle_buffer( buffer_id );
+    throw;
+  }
+
+  bool exit = false;
+  for ( const auto & datagram : datagrams_ ) {
+    if ( not action.active ) {
+      break;
+    }
+
+    const auto callback_result = action.callback( datagram );
+    if ( callback_result.result == ResultType::Exit ) {
+      result = Poller::Result( Poller::Result::Type::Exit, callback_result.exit_status );
+      exit = true;
+      break;
+    } else if ( callback_result.result == ResultType::Cancel ) {
+      action.active = false;
+
+      io_uring_sqe & sqe = next_sqe();
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = user_data( Completion::Receive, index );
+      sqe.user_data = user_data( Completion::Cancel, index );
+    }
+  }
+
+  recycle_buffer( buffer_id );
+  return exit;
+}
+
+/* submit queued work, wait up to timeout_ms for completions, and run callbacks */
+Poller::Result URingEngine::wait( const int & timeout_ms )
+{
+  /* (re-)arm receives the kernel has dropped */
+  bool anything_pending = sends_in_flight_ > 0;
+  for ( size_t i = 0; i < receive_actions_.size(); i++ ) {
+    if ( receive_actions_[ i ]->active ) {
+      anything_pending = true;
+      if ( not receive_actions_[ i ]->armed ) {
+	arm_receive( i );
+      }
+    }
+  }
+
+  /* Quit if there's nothing to wait for */
+  if ( not anything_pending ) {
+    return Poller::Result::Type::Exit;
+  }
+
+  const bool have_completions =
+    __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE ) != *cq_head_;
+
+  if ( enter( have_completions ? 0 : 1, timeout_ms ) < 0 ) {
+    if ( errno == EINTR ) {
+      return Poller::Result::Type::Exit;
+    }
+    throw unix_error( "io_uring_enter" );
+  }
+
+  unsigned int head = *cq_head_;
+  const unsigned int tail = __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE );
+
+  if ( head == tail ) {
+    return Poller::Result::Type::Timeout;
+  }
+
+  Poller::Result result( Poller::Result::Type::Success );
+  while ( head != tail ) {
+    const io_uring_cqe cqe = cqes_[ head & *cq_mask_ ];
+    head++;
+    __atomic_store_n( cq_head_, head, __ATOMIC_RELEASE );
+
+    if ( complete( cqe, result ) ) {
+      break;
+    }
+  }
+
+  return result;
+}
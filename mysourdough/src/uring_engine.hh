@@ -0,0 +1,124 @@
+#ifndef URING_ENGINE_HH
+#define URING_ENGINE_HH
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "file_descriptor.hh"
+#include "poller.hh"
+#include "socket.hh"
+
+/* io_uring-based event loop: an alternative to Poller that keeps
+   multishot receives armed and queues sends without waiting for
+   writability, so one syscall both submits and reaps a batch of work */
+class URingEngine
+{
+public:
+  typedef Poller::Action::Result CallbackResult;
+  typedef std::function<CallbackResult( const UDPSocket::datagram_view & )> ReceiveCallback;
+
+private:
+  /* size and count of the buffers the kernel picks from for receives */
+  const static size_t BUFFER_SIZE = 65536 + 2048;
+  const static unsigned int BUFFER_COUNT = 64;
+
+  /* a multishot receive on one socket */
+  struct ReceiveAction
+  {
+    UDPSocket & socket;
+    ReceiveCallback callback;
+    msghdr header; /* tells the kernel how much room to leave for name and control data */
+    bool armed;
+    bool active;
+
+    ReceiveAction( UDPSocket & s_socket, const ReceiveCallback & s_callback );
+  };
+
+  /* a send the kernel may still be reading from */
+  struct PendingSend
+  {
+    std::string payload;
+    Address::raw destination;
+    iovec payload_iovec;
+    msghdr header;
+
+    PendingSend();
+  };
+
+  io_uring_params params_;
+  FileDescriptor ring_fd_;
+
+  /* shared submission/completion ring and the submission entries */
+  void * rings_;
+  size_t rings_size_;
+  io_uring_sqe * sqes_;
+  unsigned int * sq_head_, * sq_tail_, * sq_mask_, * sq_array_;
+  unsigned int * cq_head_, * cq_tail_, * cq_mask_;
+  io_uring_cqe * cqes_;
+
+  /* submission entries prepared but not yet handed to the kernel */
+  unsigned int sq_local_tail_;
+  unsigned int to_submit_;
+
+  /* provided-buffer ring used by the multishot receives */
+  io_uring_buf_ring * buf_ring_;
+  std::vector<char> buffers_;
+
+  std::vector< std::unique_ptr<ReceiveAction> > receive_actions_;
+  std::vector< std::unique_ptr<PendingSend> > sends_;
+  std::vector< size_t > free_sends_;
+  size_t sends_in_flight_;
+
+  /* scratch space for the datagrams in one completion */
+  std::vector<UDPSocket::datagram_view> datagrams_;
+
+  /* get a zeroed submission entry (flushing to the kernel if the ring is full) */
+  io_uring_sqe & next_sqe();
+
+  /* hand prepared entries to the kernel, optionally waiting for a completion */
+  int enter( const unsigned int min_complete, const int timeout_ms );
+
+  void arm_receive( const size_t index );
+  void recycle_buffer( const unsigned int buffer_id );
+  size_t free_send();
+  size_t new_send( std::string && payload );
+  size_t new_send( const char * data, const size_t length );
+  void prepare_send( const size_t index );
+  void queue_send( const FileDescriptor & fd, const size_t index );
+  void queue_sendto( const FileDescriptor & fd, const Address & destination,
+		     const size_t index );
+
+  /* handle one completion; returns true (and fills in result) if the loop should exit */
+  bool complete( const io_uring_cqe & cqe, Poller::Result & result );
+
+public:
+  URingEngine( const unsigned int entries = 256 );
+  ~URingEngine();
+
+  /* keep a multishot receive armed on socket; callback runs once per datagram */
+  void add_receive_action( UDPSocket & socket, const ReceiveCallback & callback );
+
+  /* queue a datagram to the socket's connected peer */
+  void send( UDPSocket & socket, std::string && payload );
+
+  /* same, copying the bytes into a recycled buffer (no allocation once warm) */
+  void send( UDPSocket & socket, const char * data, const size_t length );
+
+  /* queue a datagram to a specified address */
+  void sendto( UDPSocket & socket, const Address & destination, std::string && payload );
+  void sendto( UDPSocket & socket, const Address & destination,
+	       const char * data, const size_t length );
+
+  /* submit queued work, wait up to timeout_ms for completions, and run callbacks */
+  Poller::Result wait( const int & timeout_ms );
+
+  /* forbid copying (the kernel holds pointers into our rings and buffers) */
+  URingEngine( const URingEngine & other ) = delete;
+  const URingEngine & operator=( const URingEngine & other ) = delete;
+};
+
+#endif /* URING_ENGINE_HH */
@@ -5,6 +5,9 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <limits>
 
 /* tagged_error: system_error + name of what was being attempted */
 class tagged_error : public std::system_error
@@ -58,6 +61,25 @@ inline int SystemCall( const std::string & s_attempt, const int return_value )
   return SystemCall( s_attempt.c_str(), return_value );
 }
 
+/* parse a command-line argument that must be a whole decimal number
+   (false, leaving value alone, if it's anything else or too large) */
+inline bool parse_unsigned( const std::string & s, unsigned int & value )
+{
+  if ( s.empty() or not isdigit( static_cast<unsigned char>( s.front() ) ) ) {
+    return false;
+  }
+
+  errno = 0;
+  char * end;
+  const unsigned long parsed = strtoul( s.c_str(), &end, 10 );
+  if ( errno or *end or parsed > std::numeric_limits<unsigned int>::max() ) {
+    return false;
+  }
+
+  value = parsed;
+  return true;
+}
+
 /* zero out an arbitrary structure */
 template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 